@@ -0,0 +1,485 @@
+#include "chip.h"
+#include "disasm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Static ROM analyzer and disassembler.
+//
+//   analyze [--profile NAME] [-l] [-j] rom ...
+//
+// Finds the code in each ROM by recursive traversal from 0x200, decoding
+// with the profile's rules, and calls everything it does not reach data.
+// Reports the instruction mix, indirect jumps, and stores through I that
+// land in code (self-modifying) or whose target cannot be worked out. A
+// ROM with none of those is reported cacheable: its code can be decoded
+// once ahead of time. -l lists the classified ROM, -j writes JSON.
+
+#define MAX_MNEMONICS 64
+#define MAX_REPORTED 32 // self-modifying stores listed per ROM
+#define BACKTRACK 64    // instructions searched back for the load of I
+
+// per byte of memory
+#define BYTE_CODE 1      // part of a reachable instruction
+#define BYTE_START 2     // first byte of a reachable instruction
+#define BYTE_ENTRY 4     // target of a jump or call
+#define BYTE_PROCESSED 8 // traversal has followed this instruction
+
+typedef struct
+{
+    unsigned int pc;
+    unsigned int target;
+    int length;
+} Store;
+
+typedef struct
+{
+    char name[8];
+    int count;
+} Mnemonic;
+
+typedef struct
+{
+    const char *path;
+    Chip *chip;
+    unsigned int size; // ROM bytes from 0x200
+    unsigned char *flags;
+    int instructions;
+    int codeBytes;
+    int invalid;       // instructions the profile ignores on a code path
+    int indirectJumps; // BNNN
+    int outside;       // branches out of the ROM
+    int stores;
+    int unknownStores; // target of the store not known statically
+    int selfModifying;
+    Store reported[MAX_REPORTED];
+    Mnemonic mix[MAX_MNEMONICS];
+    int mnemonics;
+} Analysis;
+
+static int inRom(const Analysis *a, unsigned int addr)
+{
+    return addr >= 0x200 && addr < 0x200 + a->size;
+}
+
+static void decode(const Analysis *a, unsigned int addr, Instruction *ins)
+{
+    disassemble(a->chip->mem, a->chip->memSize, addr, a->chip->profile, ins);
+}
+
+static void countMnemonic(Analysis *a, const char *text)
+{
+    char name[8];
+    int n = 0;
+    while (text[n] != ' ' && text[n] != 0 && n < 7)
+    {
+        name[n] = text[n];
+        n++;
+    }
+    name[n] = 0;
+    for (int k = 0; k < a->mnemonics; k++)
+    {
+        if (strcmp(a->mix[k].name, name) == 0)
+        {
+            a->mix[k].count++;
+            return;
+        }
+    }
+    if (a->mnemonics < MAX_MNEMONICS)
+    {
+        strcpy(a->mix[a->mnemonics].name, name);
+        a->mix[a->mnemonics++].count = 1;
+    }
+}
+
+// recursive traversal from the entry point with an explicit work list
+static void traverse(Analysis *a)
+{
+    // every instruction followed pushes at most two more
+    unsigned int *work = malloc((a->chip->memSize * 2 + 1) * sizeof(unsigned int));
+    int pending = 0;
+    work[pending++] = 0x200;
+    a->flags[0x200] |= BYTE_ENTRY;
+
+    while (pending > 0)
+    {
+        unsigned int addr = work[--pending];
+        if (!inRom(a, addr))
+        {
+            a->outside++;
+            continue;
+        }
+        if (a->flags[addr] & BYTE_PROCESSED)
+        {
+            continue;
+        }
+        Instruction ins;
+        decode(a, addr, &ins);
+        a->flags[addr] |= BYTE_START | BYTE_PROCESSED;
+        for (int k = 0; k < ins.length && addr + k < a->chip->memSize; k++)
+        {
+            a->flags[addr + k] |= BYTE_CODE;
+        }
+        a->instructions++;
+        countMnemonic(a, ins.text);
+        if (!ins.valid)
+        {
+            a->invalid++;
+        }
+
+        unsigned int next = addr + ins.length;
+        switch (ins.flow)
+        {
+        case FLOW_NEXT:
+            work[pending++] = next;
+            break;
+        case FLOW_CALL:
+            work[pending++] = next;
+            // fall through
+        case FLOW_JUMP:
+            if (ins.target < a->chip->memSize)
+            {
+                a->flags[ins.target] |= BYTE_ENTRY;
+            }
+            work[pending++] = ins.target;
+            break;
+        case FLOW_INDIRECT:
+            // the offset is only known at run time; follow the base, which
+            // is usually the first entry of a jump table
+            a->indirectJumps++;
+            if (ins.target < a->chip->memSize)
+            {
+                a->flags[ins.target] |= BYTE_ENTRY;
+            }
+            work[pending++] = ins.target;
+            break;
+        case FLOW_SKIP:
+        {
+            Instruction skipped;
+            decode(a, next, &skipped);
+            work[pending++] = next;
+            work[pending++] = next + skipped.length;
+            break;
+        }
+        }
+    }
+    free(work);
+
+    for (unsigned int addr = 0x200; addr < 0x200 + a->size; addr++)
+    {
+        a->codeBytes += (a->flags[addr] & BYTE_CODE) != 0;
+    }
+}
+
+// how far FX55 and FX65 move I, as in the interpreters in chip.c
+static int iIncrement(int profile, int x)
+{
+    switch (profile)
+    {
+    case PROFILE_CHIP48:
+        return x;
+    case PROFILE_SCHIP:
+        return 0;
+    default:
+        return x + 1;
+    }
+}
+
+// the instruction that falls through to addr, 0 if there is none
+static unsigned int previous(const Analysis *a, unsigned int addr, Instruction *ins)
+{
+    for (int length = 2; length <= 4; length += 2)
+    {
+        unsigned int prev = addr - length;
+        if (addr >= 0x200 + (unsigned int)length && (a->flags[prev] & BYTE_START))
+        {
+            decode(a, prev, ins);
+            if (ins->length == length && (ins->flow == FLOW_NEXT || ins->flow == FLOW_SKIP))
+            {
+                return prev;
+            }
+        }
+    }
+    return 0;
+}
+
+// I at the instruction at addr, found by walking back through straight
+// line code to the ANNN or F000 NNNN that set it; -1 if it is not known.
+// Skips are followed both ways, so only code a skip guards is uncertain.
+static long knownI(const Analysis *a, unsigned int addr)
+{
+    long adjust = 0;
+    for (int k = 0; k < BACKTRACK; k++)
+    {
+        Instruction ins, before;
+        if (a->flags[addr] & BYTE_ENTRY)
+        {
+            // reached from elsewhere as well
+            return -1;
+        }
+        unsigned int prev = previous(a, addr, &ins);
+        if (prev == 0)
+        {
+            return -1;
+        }
+        // an instruction that may be skipped only changes I sometimes
+        int conditional = previous(a, prev, &before) != 0 && before.flow == FLOW_SKIP;
+        unsigned short op = ins.opcode;
+        int x = (op >> 8) & 0xF;
+        if ((op & 0xF000) == 0xA000 || (ins.length == 4 && op == 0xF000))
+        {
+            if (conditional)
+            {
+                return -1;
+            }
+            return (ins.length == 4 ? ins.operand : (op & 0xFFF)) + adjust;
+        }
+        if ((op & 0xF000) == 0xF000)
+        {
+            switch (op & 0xFF)
+            {
+            case 0x55:
+            case 0x65:
+                if (conditional && iIncrement(a->chip->profile, x) != 0)
+                {
+                    return -1;
+                }
+                adjust += iIncrement(a->chip->profile, x);
+                break;
+            case 0x1E:
+            case 0x29:
+            case 0x30:
+                return -1;
+            }
+        }
+        addr = prev;
+    }
+    return -1;
+}
+
+static void findStores(Analysis *a)
+{
+    for (unsigned int addr = 0x200; addr < 0x200 + a->size; addr++)
+    {
+        Instruction ins;
+        if (!(a->flags[addr] & BYTE_START))
+        {
+            continue;
+        }
+        decode(a, addr, &ins);
+        if (ins.store == 0)
+        {
+            continue;
+        }
+        a->stores++;
+        long i = knownI(a, addr);
+        if (i < 0)
+        {
+            a->unknownStores++;
+            continue;
+        }
+        for (int k = 0; k < ins.store; k++)
+        {
+            if (i + k < a->chip->memSize && (a->flags[i + k] & BYTE_CODE))
+            {
+                if (a->selfModifying < MAX_REPORTED)
+                {
+                    Store *s = &a->reported[a->selfModifying];
+                    s->pc = addr;
+                    s->target = i;
+                    s->length = ins.store;
+                }
+                a->selfModifying++;
+                break;
+            }
+        }
+    }
+}
+
+static int cacheable(const Analysis *a)
+{
+    return a->selfModifying == 0 && a->unknownStores == 0 && a->indirectJumps == 0;
+}
+
+static int compareMix(const void *p, const void *q)
+{
+    int x = ((const Mnemonic *)p)->count, y = ((const Mnemonic *)q)->count;
+    return (y > x) - (y < x);
+}
+
+static void listing(const Analysis *a)
+{
+    unsigned int addr = 0x200;
+    while (addr < 0x200 + a->size)
+    {
+        if (a->flags[addr] & BYTE_START)
+        {
+            Instruction ins;
+            decode(a, addr, &ins);
+            printf("%c%04X  %04X  %s\n", a->flags[addr] & BYTE_ENTRY ? '>' : ' ', addr, ins.opcode, ins.text);
+            addr += ins.length;
+            continue;
+        }
+        if (a->flags[addr] & BYTE_CODE)
+        {
+            // the tail of an instruction that starts before the ROM
+            addr++;
+            continue;
+        }
+        printf(" %04X  DB  ", addr);
+        for (int n = 0; n < 8 && addr < 0x200 + a->size && !(a->flags[addr] & BYTE_CODE); n++, addr++)
+        {
+            printf("%s#%02X", n ? ", " : " ", a->chip->mem[addr]);
+        }
+        printf("\n");
+    }
+}
+
+static void writeText(const Analysis *a)
+{
+    printf("%s: %u bytes, %d instructions in %d code bytes, %u data bytes\n", a->path, a->size, a->instructions,
+           a->codeBytes, a->size - a->codeBytes);
+    printf("  invalid instructions on code paths: %d, branches outside the ROM: %d\n", a->invalid, a->outside);
+    printf("  indirect jumps: %d, stores: %d (%d with unknown target, %d into code)\n", a->indirectJumps, a->stores,
+           a->unknownStores, a->selfModifying);
+    for (int k = 0; k < a->selfModifying && k < MAX_REPORTED; k++)
+    {
+        const Store *s = &a->reported[k];
+        printf("  self-modifying: %04X writes %04X-%04X\n", s->pc, s->target, s->target + s->length - 1);
+    }
+    printf("  mix:");
+    for (int k = 0; k < a->mnemonics; k++)
+    {
+        printf(" %s %d", a->mix[k].name, a->mix[k].count);
+    }
+    printf("\n  cacheable: %s\n", cacheable(a) ? "yes" : "no");
+}
+
+static void writeString(const char *s)
+{
+    putchar('"');
+    for (; *s; s++)
+    {
+        if (*s == '"' || *s == '\\')
+        {
+            putchar('\\');
+        }
+        if ((unsigned char)*s >= 0x20)
+        {
+            putchar(*s);
+        }
+    }
+    putchar('"');
+}
+
+static void writeJson(const Analysis *a, int last)
+{
+    printf("    {\"rom\": ");
+    writeString(a->path);
+    printf(", \"size\": %u, \"instructions\": %d, \"code_bytes\": %d, \"data_bytes\": %u,\n", a->size,
+           a->instructions, a->codeBytes, a->size - a->codeBytes);
+    printf("     \"invalid\": %d, \"outside\": %d, \"indirect_jumps\": %d, \"stores\": %d, "
+           "\"unknown_stores\": %d,\n",
+           a->invalid, a->outside, a->indirectJumps, a->stores, a->unknownStores);
+    printf("     \"self_modifying\": [");
+    for (int k = 0; k < a->selfModifying && k < MAX_REPORTED; k++)
+    {
+        const Store *s = &a->reported[k];
+        printf("%s{\"pc\": %u, \"target\": %u, \"length\": %d}", k ? ", " : "", s->pc, s->target, s->length);
+    }
+    printf("],\n     \"mix\": {");
+    for (int k = 0; k < a->mnemonics; k++)
+    {
+        printf("%s\"%s\": %d", k ? ", " : "", a->mix[k].name, a->mix[k].count);
+    }
+    printf("}, \"cacheable\": %s}%s\n", cacheable(a) ? "true" : "false", last ? "" : ",");
+}
+
+int main(int argc, char **argv)
+{
+    int profile = -1;
+    int list = 0, json = 0;
+    int romCount = 0;
+
+    for (int a = 1; a < argc; a++)
+    {
+        if (strcmp(argv[a], "--profile") == 0 && a + 1 < argc)
+        {
+            profile = profileFromName(argv[++a]);
+            if (profile < 0)
+            {
+                fprintf(stderr, "Unknown profile %s\n", argv[a]);
+                return 2;
+            }
+        }
+        else if (strcmp(argv[a], "-l") == 0)
+        {
+            list = 1;
+        }
+        else if (strcmp(argv[a], "-j") == 0)
+        {
+            json = 1;
+        }
+        else if (argv[a][0] == '-')
+        {
+            romCount = 0;
+            break;
+        }
+        else
+        {
+            argv[++romCount] = argv[a];
+        }
+    }
+    if (romCount == 0)
+    {
+        fprintf(stderr, "usage: analyze [--profile NAME] [-l] [-j] rom ...\n");
+        return 2;
+    }
+
+    if (json)
+    {
+        printf("{\"roms\": [\n");
+    }
+    for (int r = 1; r <= romCount; r++)
+    {
+        FILE *fpin = fopen(argv[r], "rb");
+        if (fpin == NULL)
+        {
+            fprintf(stderr, "Error opening ROM %s\n", argv[r]);
+            return 127;
+        }
+        Analysis a;
+        memset(&a, 0, sizeof(a));
+        a.path = argv[r];
+        a.chip = createMachine(profile >= 0 ? profile : profileForRom(argv[r]));
+        fseek(fpin, 0, SEEK_END);
+        long size = ftell(fpin);
+        rewind(fpin);
+        a.size = size < (long)(a.chip->memSize - 0x200) ? (unsigned int)size : a.chip->memSize - 0x200;
+        loadRom(fpin, a.chip);
+        a.flags = calloc(a.chip->memSize, 1);
+
+        traverse(&a);
+        findStores(&a);
+        qsort(a.mix, a.mnemonics, sizeof(a.mix[0]), compareMix);
+        if (json)
+        {
+            writeJson(&a, r == romCount);
+        }
+        else
+        {
+            writeText(&a);
+            if (list)
+            {
+                listing(&a);
+            }
+        }
+        free(a.flags);
+        destroyChip(a.chip);
+    }
+    if (json)
+    {
+        printf("]}\n");
+    }
+    return 0;
+}
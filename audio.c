@@ -0,0 +1,150 @@
+#include "audio.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define AUDIO_RATE 48000
+#define AUDIO_SAMPLES 512 // per callback, about 11 ms
+#define AUDIO_QUEUE 256   // frames of sound state, a power of two
+#define AUDIO_FRAME_RATE 60
+#define AUDIO_DRIFT 3    // frames playback may drift from emulated time before it jumps
+#define AMPLITUDE 3000
+#define BUZZER_HZ 440
+
+// sample a frame of emulated time starts on
+static uint64_t frameStart(const Audio *a, uint64_t frame)
+{
+    return frame * a->rate / AUDIO_FRAME_RATE;
+}
+
+static void applyEvent(Audio *a, const AudioEvent *e)
+{
+    if (e->on && !a->current.on)
+    {
+        a->phase = 0;
+    }
+    a->current = *e;
+    // XO-CHIP plays the 128 bit pattern at 4000 * 2^((pitch - 64) / 48) bits/s
+    a->step = a->xo ? 4000 * pow(2, (e->pitch - 64) / 48.0) / a->rate : (double)BUZZER_HZ / a->rate;
+}
+
+static void fill(void *userdata, Uint8 *stream, int len)
+{
+    Audio *a = userdata;
+    int16_t *out = (int16_t *)stream;
+    int count = len / sizeof(int16_t);
+    uint32_t head = atomic_load_explicit(&a->head, memory_order_acquire);
+    uint32_t tail = atomic_load_explicit(&a->tail, memory_order_relaxed);
+
+    if (tail != head)
+    {
+        // the emulator stalled or ran fast: resume at the oldest queued state
+        uint64_t start = frameStart(a, a->events[tail & a->mask].frame);
+        uint64_t drift = frameStart(a, AUDIO_DRIFT);
+        if (start + drift < a->position || start > a->position + drift)
+        {
+            a->position = start;
+        }
+    }
+    for (int s = 0; s < count; s++)
+    {
+        while (tail != head && frameStart(a, a->events[tail & a->mask].frame) <= a->position)
+        {
+            applyEvent(a, &a->events[tail & a->mask]);
+            tail++;
+        }
+        int bit = 0;
+        if (a->current.on)
+        {
+            if (a->xo)
+            {
+                int n = (int)a->phase;
+                bit = a->current.pattern[n >> 3] >> (7 - (n & 7)) & 1;
+                a->phase = fmod(a->phase + a->step, 128);
+            }
+            else
+            {
+                bit = a->phase < 0.5;
+                a->phase = fmod(a->phase + a->step, 1);
+            }
+        }
+        out[s] = a->current.on ? (bit ? AMPLITUDE : -AMPLITUDE) : 0;
+        a->position++;
+    }
+    atomic_store_explicit(&a->tail, tail, memory_order_release);
+}
+
+// opens the default output device, NULL if there is none
+Audio *createAudio(int xo)
+{
+    if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0)
+    {
+        return NULL;
+    }
+    Audio *a = calloc(1, sizeof(Audio));
+    if (a == NULL || (a->events = calloc(AUDIO_QUEUE, sizeof(AudioEvent))) == NULL)
+    {
+        free(a);
+        SDL_QuitSubSystem(SDL_INIT_AUDIO);
+        return NULL;
+    }
+    a->mask = AUDIO_QUEUE - 1;
+    a->xo = xo;
+    atomic_init(&a->head, 0);
+    atomic_init(&a->tail, 0);
+
+    SDL_AudioSpec want, have;
+    SDL_zero(want);
+    want.freq = AUDIO_RATE;
+    want.format = AUDIO_S16SYS;
+    want.channels = 1;
+    want.samples = AUDIO_SAMPLES;
+    want.callback = fill;
+    want.userdata = a;
+    a->device = SDL_OpenAudioDevice(NULL, 0, &want, &have, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE);
+    if (a->device == 0)
+    {
+        destroyAudio(a);
+        return NULL;
+    }
+    a->rate = have.freq;
+    SDL_PauseAudioDevice(a->device, 0);
+    return a;
+}
+
+// queues the sound state for the frame the chip is about to run; called
+// once per frame by the emulation thread, drops the state if the callback
+// has fallen a whole queue behind
+void queueAudio(Audio *a, const Chip *c)
+{
+    if (a == NULL)
+    {
+        return;
+    }
+    uint32_t head = atomic_load_explicit(&a->head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&a->tail, memory_order_acquire) > a->mask)
+    {
+        return;
+    }
+    AudioEvent *e = &a->events[head & a->mask];
+    e->frame = c->frame;
+    e->on = c->soundTimer > 0;
+    e->pitch = c->pitch;
+    memcpy(e->pattern, c->pattern, sizeof(e->pattern));
+    atomic_store_explicit(&a->head, head + 1, memory_order_release);
+}
+
+void destroyAudio(Audio *a)
+{
+    if (a == NULL)
+    {
+        return;
+    }
+    if (a->device != 0)
+    {
+        SDL_CloseAudioDevice(a->device);
+    }
+    free(a->events);
+    free(a);
+    SDL_QuitSubSystem(SDL_INIT_AUDIO);
+}
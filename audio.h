@@ -0,0 +1,42 @@
+#ifndef AUDIO_H
+#define AUDIO_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <SDL2/SDL.h>
+#include "chip.h"
+
+// the sound state for one emulated frame
+typedef struct
+{
+    uint64_t frame; // emulated time the state takes effect
+    unsigned char on;
+    unsigned char pitch;
+    unsigned char pattern[16];
+} AudioEvent;
+
+// Buzzer output. The emulation thread queues the sound state once per
+// frame; the SDL audio callback consumes it through a single-producer,
+// single-consumer ring and places each change at the sample its frame
+// starts on, so the timing does not depend on when the frame was run.
+typedef struct
+{
+    SDL_AudioDeviceID device;
+    int rate; // samples per second
+    int xo;   // play the XO-CHIP pattern buffer instead of a square wave
+    AudioEvent *events;
+    uint32_t mask;          // capacity - 1, capacity is a power of two
+    _Atomic uint32_t head; // written by the emulation thread
+    _Atomic uint32_t tail; // written by the audio callback
+    // audio callback only
+    uint64_t position; // in samples of emulated time
+    AudioEvent current;
+    double phase; // position in the square wave period or pattern, in bits
+    double step;  // phase advance per sample
+} Audio;
+
+Audio *createAudio(int xo);
+void queueAudio(Audio *a, const Chip *c);
+void destroyAudio(Audio *a);
+
+#endif
@@ -0,0 +1,268 @@
+#include "chip.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Microbenchmarks for the interpreter and whole-ROM throughput.
+//
+//   bench [-r REPETITIONS] [-n OPS] [-f FRAMES] [-o results.json] [rom ...]
+//
+// Every benchmark is run REPETITIONS times; each run is one sample. The
+// instruction benchmarks report nanoseconds per executed instruction, the
+// ROM benchmarks report emulated instructions per second over FRAMES frames.
+
+#define REPETITIONS 10
+#define OPS (1 << 20)
+#define FRAMES 3000
+#define INSTRUCTIONS_PER_FRAME 12
+#define PROGRAM_SIZE 1024 // copies of the opcode laid out from 0x200
+
+typedef struct
+{
+    const char *name;
+    unsigned short opcode;
+    unsigned char vx; // V0, used as the x coordinate by the draw benchmarks
+    unsigned char vy; // V1
+} OpBench;
+
+static const OpBench opBenches[] = {
+    {"alu/8XY0", 0x8010},
+    {"alu/8XY1", 0x8011},
+    {"alu/8XY2", 0x8012},
+    {"alu/8XY3", 0x8013},
+    {"alu/8XY4", 0x8014},
+    {"alu/8XY5", 0x8015},
+    {"alu/8XY6", 0x8016},
+    {"alu/8XY7", 0x8017},
+    {"alu/8XYE", 0x801E},
+    {"draw/DXY1", 0xD011, 0, 0},
+    {"draw/DXY5", 0xD015, 0, 0},
+    {"draw/DXYF", 0xD01F, 0, 0},
+    {"draw/DXY5-unaligned", 0xD015, 13, 7},
+    {"draw/DXY5-clipped", 0xD015, 60, 28},
+    {"draw/DXYF-clipped", 0xD01F, 60, 28},
+    {"mem/FX55", 0xFF55},
+    {"mem/FX65", 0xFF65},
+    {"clear/00E0", 0x00E0},
+};
+
+typedef struct
+{
+    char name[256];
+    const char *unit;
+    int higherIsBetter;
+    double *samples;
+    int count;
+} Result;
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int compareDouble(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double median(const double *samples, int count)
+{
+    double *sorted = malloc(count * sizeof(double));
+    memcpy(sorted, samples, count * sizeof(double));
+    qsort(sorted, count, sizeof(double), compareDouble);
+    double m = count % 2 ? sorted[count / 2] : (sorted[count / 2 - 1] + sorted[count / 2]) / 2;
+    free(sorted);
+    return m;
+}
+
+// ns per instruction for one opcode repeated through memory
+static double runOp(const OpBench *b, long ops)
+{
+    Chip *c = createChip();
+    for (int k = 0; k < PROGRAM_SIZE; k++)
+    {
+        c->mem[0x200 + 2 * k] = b->opcode >> 8;
+        c->mem[0x200 + 2 * k + 1] = b->opcode & 0xFF;
+    }
+    c->v[0] = b->vx;
+    c->v[1] = b->vy;
+    c->v[2] = 0x5A;
+    // sprites come from the font, loads and stores go above the program
+    c->i = (b->opcode & 0xF000) == 0xD000 ? 0x50 : 0xC00;
+
+    double start = now();
+    for (long n = 0; n < ops; n += PROGRAM_SIZE)
+    {
+        c->pc = 0x200;
+        for (int k = 0; k < PROGRAM_SIZE; k++)
+        {
+            cycle(c);
+        }
+    }
+    double elapsed = now() - start;
+    long executed = (ops + PROGRAM_SIZE - 1) / PROGRAM_SIZE * PROGRAM_SIZE;
+    destroyChip(c);
+    return elapsed * 1e9 / executed;
+}
+
+// emulated instructions per second for a ROM run headlessly; only the
+// instructions that ran count, not idle-loop passes skipped or frames
+// spent halted in FX0A
+static double runRom(const char *path, int frames)
+{
+    FILE *fpin = fopen(path, "rb");
+    if (fpin == NULL)
+    {
+        return -1;
+    }
+    Chip *c = createMachine(profileForRom(path));
+    loadRom(fpin, c);
+
+    double start = now();
+    for (int f = 0; f < frames; f++)
+    {
+        runFrame(c, INSTRUCTIONS_PER_FRAME);
+    }
+    double elapsed = now() - start;
+    double executed = c->instructions;
+    destroyChip(c);
+    return executed / elapsed;
+}
+
+static void writeString(FILE *fpout, const char *s)
+{
+    fputc('"', fpout);
+    for (; *s; s++)
+    {
+        if (*s == '"' || *s == '\\')
+        {
+            fputc('\\', fpout);
+        }
+        if ((unsigned char)*s >= 0x20)
+        {
+            fputc(*s, fpout);
+        }
+    }
+    fputc('"', fpout);
+}
+
+static void writeResults(FILE *fpout, Result *results, int count, int repetitions, long ops, int frames)
+{
+    fprintf(fpout, "{\n  \"context\": {\"repetitions\": %d, \"ops\": %ld, \"frames\": %d, "
+                   "\"instructions_per_frame\": %d},\n",
+            repetitions, ops, frames, INSTRUCTIONS_PER_FRAME);
+    fprintf(fpout, "  \"benchmarks\": [\n");
+    for (int r = 0; r < count; r++)
+    {
+        Result *res = &results[r];
+        fprintf(fpout, "    {\"name\": ");
+        writeString(fpout, res->name);
+        fprintf(fpout, ", \"unit\": \"%s\", \"higher_is_better\": %s, \"median\": %.6g,\n",
+                res->unit, res->higherIsBetter ? "true" : "false", median(res->samples, res->count));
+        fprintf(fpout, "     \"samples\": [");
+        for (int k = 0; k < res->count; k++)
+        {
+            fprintf(fpout, "%s%.6g", k ? ", " : "", res->samples[k]);
+        }
+        fprintf(fpout, "]}%s\n", r + 1 < count ? "," : "");
+    }
+    fprintf(fpout, "  ]\n}\n");
+}
+
+int main(int argc, char **argv)
+{
+    int repetitions = REPETITIONS;
+    long ops = OPS;
+    int frames = FRAMES;
+    const char *outPath = NULL;
+    int romCount = 0;
+    char **roms = malloc(argc * sizeof(char *));
+
+    for (int a = 1; a < argc; a++)
+    {
+        if (strcmp(argv[a], "-r") == 0 && a + 1 < argc)
+        {
+            repetitions = atoi(argv[++a]);
+        }
+        else if (strcmp(argv[a], "-n") == 0 && a + 1 < argc)
+        {
+            ops = atol(argv[++a]);
+        }
+        else if (strcmp(argv[a], "-f") == 0 && a + 1 < argc)
+        {
+            frames = atoi(argv[++a]);
+        }
+        else if (strcmp(argv[a], "-o") == 0 && a + 1 < argc)
+        {
+            outPath = argv[++a];
+        }
+        else if (argv[a][0] == '-')
+        {
+            fprintf(stderr, "usage: bench [-r REPETITIONS] [-n OPS] [-f FRAMES] [-o results.json] [rom ...]\n");
+            return 2;
+        }
+        else
+        {
+            roms[romCount++] = argv[a];
+        }
+    }
+    if (repetitions < 1 || ops < 1 || frames < 1)
+    {
+        fprintf(stderr, "repetitions, ops and frames must be positive\n");
+        return 2;
+    }
+
+    int opCount = sizeof(opBenches) / sizeof(opBenches[0]);
+    int count = opCount + romCount;
+    Result *results = calloc(count, sizeof(Result));
+
+    for (int b = 0; b < opCount; b++)
+    {
+        Result *res = &results[b];
+        snprintf(res->name, sizeof(res->name), "%s", opBenches[b].name);
+        res->unit = "ns/op";
+        res->samples = malloc(repetitions * sizeof(double));
+        runOp(&opBenches[b], ops / 8); // warm up
+        for (int k = 0; k < repetitions; k++)
+        {
+            res->samples[res->count++] = runOp(&opBenches[b], ops);
+        }
+        fprintf(stderr, "%-24s %10.2f ns/op\n", res->name, median(res->samples, res->count));
+    }
+    for (int r = 0; r < romCount; r++)
+    {
+        Result *res = &results[opCount + r];
+        snprintf(res->name, sizeof(res->name), "rom/%s", roms[r]);
+        res->unit = "instructions/s";
+        res->higherIsBetter = 1;
+        res->samples = malloc(repetitions * sizeof(double));
+        for (int k = 0; k < repetitions; k++)
+        {
+            double ips = runRom(roms[r], frames);
+            if (ips < 0)
+            {
+                fprintf(stderr, "Error opening ROM %s\n", roms[r]);
+                return 1;
+            }
+            res->samples[res->count++] = ips;
+        }
+        fprintf(stderr, "%-24s %10.0f instructions/s\n", res->name, median(res->samples, res->count));
+    }
+
+    FILE *fpout = outPath != NULL ? fopen(outPath, "w") : stdout;
+    if (fpout == NULL)
+    {
+        fprintf(stderr, "Error opening %s\n", outPath);
+        return 1;
+    }
+    writeResults(fpout, results, count, repetitions, ops, frames);
+    if (fpout != stdout)
+    {
+        fclose(fpout);
+    }
+    return 0;
+}
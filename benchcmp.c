@@ -0,0 +1,472 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+
+// Compares two result files written by bench and flags regressions.
+//
+//   benchcmp [-t PERCENT] [-T PREFIX=PERCENT ...] [-a ALPHA] old.json new.json
+//
+// For every benchmark present in both files it reports the medians, the
+// median absolute deviation and a distribution-free 95% confidence interval
+// of each median. A benchmark regressed when it got slower by more than its
+// threshold (-t, or the longest matching -T prefix) and a Mann-Whitney U test
+// says the difference is significant at ALPHA. Exits 1 if anything regressed.
+
+#define THRESHOLD 5.0
+#define ALPHA 0.05
+#define MAX_OVERRIDES 64
+
+typedef struct
+{
+    char *name;
+    int higherIsBetter;
+    double *samples;
+    int count;
+} Bench;
+
+typedef struct
+{
+    Bench *benches;
+    int count;
+} ResultSet;
+
+typedef struct
+{
+    const char *prefix;
+    double percent;
+} Override;
+
+// minimal reader for the JSON bench writes: objects, arrays, strings,
+// numbers and booleans; only the escapes \" and \\ are handled.
+
+typedef struct
+{
+    const char *p;
+    int error;
+} Parser;
+
+static void skipSpace(Parser *ps)
+{
+    while (isspace((unsigned char)*ps->p))
+    {
+        ps->p++;
+    }
+}
+
+static char *parseString(Parser *ps)
+{
+    skipSpace(ps);
+    if (*ps->p != '"')
+    {
+        ps->error = 1;
+        return NULL;
+    }
+    ps->p++;
+    char *out = malloc(strlen(ps->p) + 1);
+    int n = 0;
+    while (*ps->p && *ps->p != '"')
+    {
+        if (*ps->p == '\\' && ps->p[1])
+        {
+            ps->p++;
+        }
+        out[n++] = *ps->p++;
+    }
+    out[n] = 0;
+    if (*ps->p != '"')
+    {
+        ps->error = 1;
+    }
+    else
+    {
+        ps->p++;
+    }
+    return out;
+}
+
+static void skipValue(Parser *ps)
+{
+    skipSpace(ps);
+    if (*ps->p == '"')
+    {
+        free(parseString(ps));
+        return;
+    }
+    if (*ps->p == '{' || *ps->p == '[')
+    {
+        int depth = 0;
+        do
+        {
+            if (*ps->p == '"')
+            {
+                free(parseString(ps));
+                continue;
+            }
+            if (*ps->p == '{' || *ps->p == '[')
+            {
+                depth++;
+            }
+            else if (*ps->p == '}' || *ps->p == ']')
+            {
+                depth--;
+            }
+            else if (*ps->p == 0)
+            {
+                ps->error = 1;
+                return;
+            }
+            ps->p++;
+        } while (depth > 0 && !ps->error);
+        return;
+    }
+    while (*ps->p && *ps->p != ',' && *ps->p != '}' && *ps->p != ']')
+    {
+        ps->p++;
+    }
+}
+
+static int expect(Parser *ps, char ch)
+{
+    skipSpace(ps);
+    if (*ps->p != ch)
+    {
+        ps->error = 1;
+        return 0;
+    }
+    ps->p++;
+    return 1;
+}
+
+static int accept(Parser *ps, char ch)
+{
+    skipSpace(ps);
+    if (*ps->p == ch)
+    {
+        ps->p++;
+        return 1;
+    }
+    return 0;
+}
+
+static void parseBench(Parser *ps, Bench *b)
+{
+    memset(b, 0, sizeof(Bench));
+    expect(ps, '{');
+    while (!ps->error && !accept(ps, '}'))
+    {
+        char *key = parseString(ps);
+        expect(ps, ':');
+        skipSpace(ps);
+        if (ps->error)
+        {
+            free(key);
+            return;
+        }
+        if (strcmp(key, "name") == 0)
+        {
+            b->name = parseString(ps);
+        }
+        else if (strcmp(key, "higher_is_better") == 0)
+        {
+            b->higherIsBetter = strncmp(ps->p, "true", 4) == 0;
+            skipValue(ps);
+        }
+        else if (strcmp(key, "samples") == 0)
+        {
+            int capacity = 16;
+            b->samples = malloc(capacity * sizeof(double));
+            expect(ps, '[');
+            while (!ps->error && !accept(ps, ']'))
+            {
+                char *end;
+                double x = strtod(ps->p, &end);
+                if (end == ps->p)
+                {
+                    ps->error = 1;
+                    break;
+                }
+                ps->p = end;
+                if (b->count == capacity)
+                {
+                    capacity *= 2;
+                    b->samples = realloc(b->samples, capacity * sizeof(double));
+                }
+                b->samples[b->count++] = x;
+                accept(ps, ',');
+            }
+        }
+        else
+        {
+            skipValue(ps);
+        }
+        free(key);
+        accept(ps, ',');
+    }
+}
+
+static int loadResults(const char *path, ResultSet *set)
+{
+    FILE *fpin = fopen(path, "rb");
+    if (fpin == NULL)
+    {
+        fprintf(stderr, "Error opening %s\n", path);
+        return -1;
+    }
+    fseek(fpin, 0, SEEK_END);
+    long size = ftell(fpin);
+    fseek(fpin, 0, SEEK_SET);
+    char *text = malloc(size + 1);
+    text[fread(text, 1, size, fpin)] = 0;
+    fclose(fpin);
+
+    set->benches = NULL;
+    set->count = 0;
+    Parser ps = {text, 0};
+    const char *list = strstr(text, "\"benchmarks\"");
+    if (list != NULL)
+    {
+        ps.p = list + strlen("\"benchmarks\"");
+        expect(&ps, ':');
+        expect(&ps, '[');
+        int capacity = 0;
+        while (!ps.error && !accept(&ps, ']'))
+        {
+            if (set->count == capacity)
+            {
+                capacity = capacity ? capacity * 2 : 32;
+                set->benches = realloc(set->benches, capacity * sizeof(Bench));
+            }
+            parseBench(&ps, &set->benches[set->count++]);
+            accept(&ps, ',');
+        }
+    }
+    free(text);
+    if (list == NULL || ps.error)
+    {
+        fprintf(stderr, "%s is not a bench result file\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+static int compareDouble(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double medianSorted(const double *sorted, int n)
+{
+    return n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+}
+
+typedef struct
+{
+    double median;
+    double mad; // scaled to estimate the standard deviation
+    double low, high;
+} Summary;
+
+static Summary summarize(const Bench *b)
+{
+    Summary s;
+    int n = b->count;
+    double *sorted = malloc(n * sizeof(double));
+    memcpy(sorted, b->samples, n * sizeof(double));
+    qsort(sorted, n, sizeof(double), compareDouble);
+    s.median = medianSorted(sorted, n);
+
+    double *dev = malloc(n * sizeof(double));
+    for (int k = 0; k < n; k++)
+    {
+        dev[k] = fabs(sorted[k] - s.median);
+    }
+    qsort(dev, n, sizeof(double), compareDouble);
+    s.mad = 1.4826 * medianSorted(dev, n);
+
+    // order statistics bracketing the median with ~95% coverage
+    double half = 1.96 * sqrt(n) / 2;
+    int lo = (int)floor(n / 2.0 - half);
+    int hi = (int)ceil(n / 2.0 + half);
+    s.low = sorted[lo < 0 ? 0 : lo];
+    s.high = sorted[hi > n - 1 ? n - 1 : hi];
+    free(dev);
+    free(sorted);
+    return s;
+}
+
+// two-sided p-value of the Mann-Whitney U test, normal approximation with
+// tie correction
+static double mannWhitney(const Bench *a, const Bench *b)
+{
+    int n1 = a->count, n2 = b->count, n = n1 + n2;
+    double *all = malloc(n * sizeof(double));
+    memcpy(all, a->samples, n1 * sizeof(double));
+    memcpy(all + n1, b->samples, n2 * sizeof(double));
+    qsort(all, n, sizeof(double), compareDouble);
+
+    // rank sum of the first sample using midranks, plus the tie term
+    double rankSum = 0, ties = 0;
+    for (int k = 0; k < n1; k++)
+    {
+        int below = 0, equal = 0;
+        for (int j = 0; j < n; j++)
+        {
+            below += all[j] < a->samples[k];
+            equal += all[j] == a->samples[k];
+        }
+        rankSum += below + (equal + 1) / 2.0;
+    }
+    for (int j = 0; j < n;)
+    {
+        int t = 1;
+        while (j + t < n && all[j + t] == all[j])
+        {
+            t++;
+        }
+        ties += (double)t * t * t - t;
+        j += t;
+    }
+    free(all);
+
+    double u = rankSum - n1 * (n1 + 1) / 2.0;
+    double mean = n1 * n2 / 2.0;
+    double var = n1 * n2 / 12.0 * ((n + 1) - ties / ((double)n * (n - 1)));
+    if (var <= 0)
+    {
+        return 1;
+    }
+    double z = (fabs(u - mean) - 0.5) / sqrt(var);
+    if (z < 0)
+    {
+        z = 0;
+    }
+    return erfc(z / sqrt(2));
+}
+
+static double thresholdFor(const char *name, double fallback, Override *overrides, int count)
+{
+    size_t best = 0;
+    double percent = fallback;
+    for (int k = 0; k < count; k++)
+    {
+        size_t len = strlen(overrides[k].prefix);
+        if (len >= best && strncmp(name, overrides[k].prefix, len) == 0)
+        {
+            best = len;
+            percent = overrides[k].percent;
+        }
+    }
+    return percent;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: benchcmp [-t PERCENT] [-T PREFIX=PERCENT ...] [-a ALPHA] old.json new.json\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    double threshold = THRESHOLD, alpha = ALPHA;
+    Override overrides[MAX_OVERRIDES];
+    int overrideCount = 0;
+    const char *paths[2];
+    int pathCount = 0;
+
+    for (int a = 1; a < argc; a++)
+    {
+        if (strcmp(argv[a], "-t") == 0 && a + 1 < argc)
+        {
+            threshold = atof(argv[++a]);
+        }
+        else if (strcmp(argv[a], "-a") == 0 && a + 1 < argc)
+        {
+            alpha = atof(argv[++a]);
+        }
+        else if (strcmp(argv[a], "-T") == 0 && a + 1 < argc && overrideCount < MAX_OVERRIDES)
+        {
+            char *spec = argv[++a];
+            char *eq = strrchr(spec, '=');
+            if (eq == NULL)
+            {
+                usage();
+            }
+            *eq = 0;
+            overrides[overrideCount].prefix = spec;
+            overrides[overrideCount].percent = atof(eq + 1);
+            overrideCount++;
+        }
+        else if (argv[a][0] == '-' || pathCount == 2)
+        {
+            usage();
+        }
+        else
+        {
+            paths[pathCount++] = argv[a];
+        }
+    }
+    if (pathCount != 2)
+    {
+        usage();
+    }
+
+    ResultSet old, cur;
+    if (loadResults(paths[0], &old) != 0 || loadResults(paths[1], &cur) != 0)
+    {
+        return 2;
+    }
+
+    int regressions = 0;
+    printf("%-28s %12s %12s %8s %8s %9s  %s\n", "benchmark", "old", "new", "mad%", "change", "p", "verdict");
+    for (int k = 0; k < cur.count; k++)
+    {
+        Bench *b = &cur.benches[k];
+        Bench *a = NULL;
+        for (int j = 0; j < old.count && a == NULL; j++)
+        {
+            if (b->name && old.benches[j].name && strcmp(old.benches[j].name, b->name) == 0)
+            {
+                a = &old.benches[j];
+            }
+        }
+        if (a == NULL || a->count == 0 || b->count == 0)
+        {
+            printf("%-28s %12s\n", b->name ? b->name : "?", "(new)");
+            continue;
+        }
+
+        Summary sa = summarize(a), sb = summarize(b);
+        // positive change means slower, whatever the unit
+        double change = 100 * (sb.median - sa.median) / sa.median;
+        if (b->higherIsBetter)
+        {
+            change = -change;
+        }
+        double p = mannWhitney(a, b);
+        double limit = thresholdFor(b->name, threshold, overrides, overrideCount);
+        int overlap = sa.low <= sb.high && sb.low <= sa.high;
+
+        const char *verdict = "ok";
+        if (change > limit && p < alpha)
+        {
+            verdict = "REGRESSION";
+            regressions++;
+        }
+        else if (change > limit)
+        {
+            verdict = "noisy";
+        }
+        else if (change < -limit && p < alpha)
+        {
+            verdict = "improved";
+        }
+        printf("%-28s %12.4g %12.4g %7.1f%% %+7.1f%% %9.4f  %s%s\n",
+               b->name, sa.median, sb.median, 100 * sb.mad / sb.median, change, p, verdict,
+               overlap ? "" : " (CIs disjoint)");
+    }
+    printf("%d regression%s (threshold %.1f%%, alpha %g)\n", regressions, regressions == 1 ? "" : "s", threshold, alpha);
+    return regressions ? 1 : 0;
+}
@@ -0,0 +1,355 @@
+#include "capture.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const uint8_t pngSignature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+
+#define STORED_BLOCK 65535 // the most a stored deflate block holds
+
+static uint32_t crcTable[256];
+static pthread_once_t crcOnce = PTHREAD_ONCE_INIT;
+
+static void makeCrcTable(void)
+{
+    for (uint32_t n = 0; n < 256; n++)
+    {
+        uint32_t c = n;
+        for (int k = 0; k < 8; k++)
+        {
+            c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+        }
+        crcTable[n] = c;
+    }
+}
+
+static uint32_t crc32(uint32_t crc, const uint8_t *data, size_t size)
+{
+    crc = ~crc;
+    for (size_t k = 0; k < size; k++)
+    {
+        crc = crcTable[(crc ^ data[k]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static uint32_t adler32(uint32_t adler, const uint8_t *data, size_t size)
+{
+    uint32_t a = adler & 0xFFFF, b = adler >> 16;
+    for (size_t k = 0; k < size; k++)
+    {
+        a = (a + data[k]) % 65521;
+        b = (b + a) % 65521;
+    }
+    return b << 16 | a;
+}
+
+static void put32(uint8_t *out, uint32_t value)
+{
+    out[0] = value >> 24;
+    out[1] = value >> 16;
+    out[2] = value >> 8;
+    out[3] = value;
+}
+
+static void writeChunk(FILE *fp, const char *type, const uint8_t *data, uint32_t size)
+{
+    uint8_t word[4];
+    put32(word, size);
+    fwrite(word, 4, 1, fp);
+    fwrite(type, 4, 1, fp);
+    if (size > 0)
+    {
+        fwrite(data, 1, size, fp);
+    }
+    uint32_t crc = crc32(crc32(0, (const uint8_t *)type, 4), data, size);
+    put32(word, crc);
+    fwrite(word, 4, 1, fp);
+}
+
+// An 8-bit palette PNG. The image is a few kilobytes, so it is stored in
+// uncompressed deflate blocks: no compressor to carry, and the writer
+// keeps up with thousands of frames a second.
+static int writePng(Capture *c, const char *path, int width, int height)
+{
+    FILE *fp = fopen(path, "wb");
+    if (fp == NULL)
+    {
+        return -1;
+    }
+    fwrite(pngSignature, sizeof(pngSignature), 1, fp);
+
+    uint8_t header[13];
+    put32(header, width);
+    put32(header + 4, height);
+    header[8] = 8;  // bit depth
+    header[9] = 3;  // palette colour
+    header[10] = 0; // deflate
+    header[11] = 0; // adaptive filtering, every row uses filter 0
+    header[12] = 0; // not interlaced
+    writeChunk(fp, "IHDR", header, sizeof(header));
+    writeChunk(fp, "PLTE", &c->palette[0][0], sizeof(c->palette));
+
+    // rows with their filter byte, then wrapped as zlib stored blocks
+    size_t rawSize = (size_t)(width + 1) * height;
+    size_t blocks = (rawSize + STORED_BLOCK - 1) / STORED_BLOCK;
+    uint8_t *raw = malloc(rawSize);
+    uint8_t *zlib = malloc(2 + rawSize + 5 * blocks + 4);
+    if (raw == NULL || zlib == NULL)
+    {
+        free(raw);
+        free(zlib);
+        fclose(fp);
+        return -1;
+    }
+    for (int y = 0; y < height; y++)
+    {
+        raw[(size_t)y * (width + 1)] = 0;
+        memcpy(raw + (size_t)y * (width + 1) + 1, c->image + (size_t)y * width, width);
+    }
+    uint8_t *out = zlib;
+    *out++ = 0x78; // deflate, 32K window
+    *out++ = 0x01; // no dictionary, check bits
+    for (size_t done = 0; done < rawSize;)
+    {
+        size_t n = rawSize - done < STORED_BLOCK ? rawSize - done : STORED_BLOCK;
+        *out++ = done + n == rawSize; // BFINAL, BTYPE 00
+        *out++ = n & 0xFF;
+        *out++ = n >> 8;
+        *out++ = ~n & 0xFF;
+        *out++ = (~n >> 8) & 0xFF;
+        memcpy(out, raw + done, n);
+        out += n;
+        done += n;
+    }
+    put32(out, adler32(1, raw, rawSize));
+    out += 4;
+    writeChunk(fp, "IDAT", zlib, out - zlib);
+    writeChunk(fp, "IEND", NULL, 0);
+    free(raw);
+    free(zlib);
+    return fclose(fp) == 0 ? 0 : -1;
+}
+
+// one YUV4MPEG2 frame, BT.601 studio range, full chroma
+static int writeY4m(Capture *c, int width, int height)
+{
+    uint8_t yuv[3][4];
+    for (int k = 0; k < 4; k++)
+    {
+        int r = c->palette[k][0], g = c->palette[k][1], b = c->palette[k][2];
+        yuv[0][k] = 16 + (66 * r + 129 * g + 25 * b + 128) / 256;
+        yuv[1][k] = 128 + (-38 * r - 74 * g + 112 * b + 128) / 256;
+        yuv[2][k] = 128 + (112 * r - 94 * g - 18 * b + 128) / 256;
+    }
+    size_t size = (size_t)width * height;
+    uint8_t *plane = malloc(size);
+    if (plane == NULL)
+    {
+        return -1;
+    }
+    fputs("FRAME\n", c->fp);
+    for (int p = 0; p < 3; p++)
+    {
+        for (size_t k = 0; k < size; k++)
+        {
+            plane[k] = yuv[p][c->image[k]];
+        }
+        fwrite(plane, 1, size, c->fp);
+    }
+    free(plane);
+    return ferror(c->fp) ? -1 : 0;
+}
+
+// scales a frame to the output size into Capture.image
+static void scaleFrame(Capture *c, const CaptureFrame *f)
+{
+    int width = DISPLAY_WIDTH * c->scale;
+    int source = f->hires ? DISPLAY_WIDTH : LORES_WIDTH;
+    int size = f->hires ? c->scale : 2 * c->scale;
+    for (int y = 0; y < DISPLAY_HEIGHT * c->scale; y++)
+    {
+        const unsigned char *row = f->pixels + (y / size) * source;
+        unsigned char *out = c->image + (size_t)y * width;
+        for (int x = 0; x < width; x++)
+        {
+            out[x] = row[x / size];
+        }
+    }
+}
+
+static void writeFrame(Capture *c, const CaptureFrame *f)
+{
+    int width = DISPLAY_WIDTH * c->scale, height = DISPLAY_HEIGHT * c->scale;
+    scaleFrame(c, f);
+    if (c->format == CAPTURE_Y4M)
+    {
+        c->failed |= writeY4m(c, width, height) < 0;
+    }
+    else
+    {
+        // name.png becomes name000000.png, name000001.png, ...
+        char path[sizeof(c->path) + 16];
+        size_t stem = strlen(c->path) - 4;
+        snprintf(path, sizeof(path), "%.*s%06llu.png", (int)stem, c->path, (unsigned long long)c->written);
+        c->failed |= writePng(c, path, width, height) < 0;
+    }
+    c->written++;
+}
+
+static void *writer(void *arg)
+{
+    Capture *c = arg;
+    pthread_mutex_lock(&c->lock);
+    for (;;)
+    {
+        while (c->count == 0 && !c->closing)
+        {
+            pthread_cond_wait(&c->ready, &c->lock);
+        }
+        if (c->count == 0)
+        {
+            break;
+        }
+        // the slot stays the writer's until count drops, so it is encoded
+        // without holding the lock
+        const CaptureFrame *f = &c->queue[(c->head - c->count + CAPTURE_QUEUE) % CAPTURE_QUEUE];
+        pthread_mutex_unlock(&c->lock);
+        writeFrame(c, f);
+        pthread_mutex_lock(&c->lock);
+        c->count--;
+        pthread_cond_signal(&c->room);
+    }
+    pthread_mutex_unlock(&c->lock);
+    return NULL;
+}
+
+// RRGGBB,RRGGBB,RRGGBB,RRGGBB for the background and the three plane colours
+static int parsePalette(uint8_t palette[4][3], const char *spec)
+{
+    for (int k = 0; k < 4; k++)
+    {
+        char *end;
+        unsigned long rgb = strtoul(spec, &end, 16);
+        if (end - spec != 6 || *end != (k < 3 ? ',' : 0))
+        {
+            return -1;
+        }
+        palette[k][0] = rgb >> 16;
+        palette[k][1] = rgb >> 8;
+        palette[k][2] = rgb;
+        spec = end + 1;
+    }
+    return 0;
+}
+
+static int hasSuffix(const char *s, const char *suffix)
+{
+    size_t n = strlen(s), m = strlen(suffix);
+    return n >= m && strcmp(s + n - m, suffix) == 0;
+}
+
+// Starts recording to path: a .y4m file, or a PNG sequence for a path
+// ending in .png. palette may be NULL for the window's colours. With
+// blocking set captureFrame waits for the writer rather than dropping a
+// frame, for headless runs where a complete video matters more than pace.
+// Returns NULL for a bad path, palette or scale.
+Capture *createCapture(const char *path, int scale, const char *palette, int blocking)
+{
+    int format = hasSuffix(path, ".y4m") ? CAPTURE_Y4M : hasSuffix(path, ".png") ? CAPTURE_PNG : -1;
+    if (format < 0 || scale < 1 || strlen(path) >= sizeof(((Capture *)0)->path))
+    {
+        return NULL;
+    }
+    Capture *c = calloc(1, sizeof(Capture));
+    if (c == NULL)
+    {
+        return NULL;
+    }
+    memcpy(c->palette, displayPalette, sizeof(displayPalette));
+    if (palette != NULL && parsePalette(c->palette, palette) < 0)
+    {
+        free(c);
+        return NULL;
+    }
+    c->format = format;
+    c->scale = scale;
+    c->blocking = blocking;
+    strcpy(c->path, path);
+    c->queue = malloc(CAPTURE_QUEUE * sizeof(CaptureFrame));
+    c->image = malloc((size_t)DISPLAY_WIDTH * DISPLAY_HEIGHT * scale * scale);
+    if (format == CAPTURE_Y4M && (c->fp = fopen(path, "wb")) != NULL)
+    {
+        fprintf(c->fp, "YUV4MPEG2 W%d H%d F60:1 Ip A1:1 C444\n", DISPLAY_WIDTH * scale, DISPLAY_HEIGHT * scale);
+    }
+    if (c->queue == NULL || c->image == NULL || (format == CAPTURE_Y4M && c->fp == NULL))
+    {
+        if (c->fp != NULL)
+        {
+            fclose(c->fp);
+        }
+        free(c->queue);
+        free(c->image);
+        free(c);
+        return NULL;
+    }
+    pthread_once(&crcOnce, makeCrcTable);
+    pthread_mutex_init(&c->lock, NULL);
+    pthread_cond_init(&c->ready, NULL);
+    pthread_cond_init(&c->room, NULL);
+    pthread_create(&c->writer, NULL, writer, c);
+    return c;
+}
+
+// queues the frame on screen; drops it if the writer is a whole queue
+// behind, unless the capture is blocking
+void captureFrame(Capture *c, const Display *d)
+{
+    pthread_mutex_lock(&c->lock);
+    while (c->count == CAPTURE_QUEUE && c->blocking)
+    {
+        pthread_cond_wait(&c->room, &c->lock);
+    }
+    if (c->count == CAPTURE_QUEUE)
+    {
+        c->dropped++;
+    }
+    else
+    {
+        CaptureFrame *f = &c->queue[c->head];
+        compositeDisplay(d, f->pixels);
+        f->hires = d->hires;
+        c->head = (c->head + 1) % CAPTURE_QUEUE;
+        c->count++;
+        pthread_cond_signal(&c->ready);
+    }
+    pthread_mutex_unlock(&c->lock);
+}
+
+// writes out the frames still queued and stops the writer; returns -1 if
+// any frame failed to write
+int closeCapture(Capture *c)
+{
+    if (c == NULL)
+    {
+        return 0;
+    }
+    pthread_mutex_lock(&c->lock);
+    c->closing = 1;
+    pthread_cond_signal(&c->ready);
+    pthread_mutex_unlock(&c->lock);
+    pthread_join(c->writer, NULL);
+
+    int failed = c->failed;
+    if (c->fp != NULL && fclose(c->fp) != 0)
+    {
+        failed = 1;
+    }
+    pthread_mutex_destroy(&c->lock);
+    pthread_cond_destroy(&c->ready);
+    pthread_cond_destroy(&c->room);
+    free(c->queue);
+    free(c->image);
+    free(c);
+    return failed ? -1 : 0;
+}
@@ -0,0 +1,53 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "display.h"
+
+#define CAPTURE_Y4M 0 // one YUV4MPEG2 4:4:4 stream
+#define CAPTURE_PNG 1 // one palette PNG per frame
+
+#define CAPTURE_QUEUE 64 // frames buffered between emulation and the writer
+
+// a frame as it was presented: one colour index (0-3) per pixel
+typedef struct
+{
+    unsigned char pixels[DISPLAY_WIDTH * DISPLAY_HEIGHT];
+    char hires;
+} CaptureFrame;
+
+// Video recording. The emulation thread copies each presented frame into
+// a bounded queue and a writer thread encodes and writes it, so file I/O
+// never runs on the emulation thread. Every frame is written at the
+// hi-res size times scale, lo-res pixels being doubled, so a video keeps
+// one size through resolution changes.
+typedef struct
+{
+    int format;   // CAPTURE_
+    int scale;    // output pixels per hi-res pixel
+    int blocking; // wait for room when the queue is full instead of dropping the frame
+    uint8_t palette[4][3];
+    char path[512]; // the .y4m file, or the PNG name the frame number is inserted into
+    FILE *fp;       // Y4M only
+    CaptureFrame *queue;
+    int head, count; // guarded by lock
+    int closing;
+    pthread_mutex_t lock;
+    pthread_cond_t ready; // a frame was queued, or closing
+    pthread_cond_t room;  // a frame was written
+    pthread_t writer;
+    // writer thread only
+    unsigned char *image; // scaled colour indices, one output frame
+    uint64_t written;
+    int failed;
+    // emulation thread only
+    uint64_t dropped;
+} Capture;
+
+Capture *createCapture(const char *path, int scale, const char *palette, int blocking);
+void captureFrame(Capture *c, const Display *d);
+int closeCapture(Capture *c);
+
+#endif
@@ -1,13 +1,16 @@
 #include "chip.h"
+#include "timing.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #define MEM_SIZE 4096  // memory size in bytes
+#define XO_MEM_SIZE 65536
 #define V_REGS_SIZE 16 // v registers
 #define STACK_SIZE 16  // v registers
-
-#define DISPLAY_WIDTH 64
-#define DISPLAY_HEIGHT 32
+#define FLAGS_SIZE 8   // SUPER-CHIP RPL user flags
+#define XO_FLAGS_SIZE 16
+#define BIG_FONT 0xA0  // 8x10 hi-res digits follow the small font
 
 unsigned char fonts[80] = {
     0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
@@ -28,27 +31,71 @@ unsigned char fonts[80] = {
     0xF0, 0x80, 0xF0, 0x80, 0x80  // F
 };
 
+unsigned char bigFonts[160] = {
+    0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, // 0
+    0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, // 1
+    0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // 2
+    0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 3
+    0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, // 4
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 5
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 6
+    0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, // 7
+    0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 8
+    0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 9
+    0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+    0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+    0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+    0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  // F
+};
+
 Chip *
 createChip()
+{
+    return createMachine(PROFILE_SCHIP);
+}
+
+Chip *createMachine(int profile)
 {
     Chip *chip = malloc(sizeof(Chip));
-    chip->mem = calloc(MEM_SIZE, sizeof(char));
+    chip->profile = profile;
+    chip->memSize = profile == PROFILE_XOCHIP ? XO_MEM_SIZE : MEM_SIZE;
+    chip->mem = calloc(chip->memSize, sizeof(char));
     chip->v = calloc(V_REGS_SIZE, sizeof(char));
     chip->stack = calloc(STACK_SIZE, sizeof(short));
     chip->delayTimer = 0;
     chip->soundTimer = 0;
     chip->updateCounter = 0;
+    chip->exited = 0;
+    chip->fault = FAULT_NONE;
+    chip->waitKey = -1;
+    chip->timing = TIMING_FAST;
+    chip->cycleBudget = 0;
+    chip->frame = 0;
+    chip->instructions = 0;
+    chip->rng = 1;
+    chip->trace = NULL;
+    chip->debug = NULL;
+    for (int i = 0; i < 16; i++)
+    {
+        chip->flags[i] = 0;
+        chip->pattern[i] = 0;
+    }
+    chip->pitch = 64;
 
     chip->sp = 0;
     chip->i = 0;
     chip->pc = 0x200;
 
     Display *display = malloc(sizeof(Display));
-    display->pixels = calloc(DISPLAY_WIDTH * DISPLAY_HEIGHT, sizeof(char));
+    display->updateCounter = 0;
+    display->planeMask = 1;
+    setResolution(display, 0);
     chip->display = display;
 
     Keypad *keypad = malloc(sizeof(Keypad));
-    keypad->pad = malloc(16 * sizeof(char));
+    keypad->pad = calloc(16, sizeof(char));
     keypad->keyPress = 0;
     chip->keypad = keypad;
 
@@ -57,9 +104,129 @@ createChip()
     {
         chip->mem[0x50 + i] = fonts[i];
     }
+    // load hi-res fonts to 0x0A0 to 0x140
+    for (int i = 0; i < 160; i++)
+    {
+        chip->mem[BIG_FONT + i] = bigFonts[i];
+    }
     return chip;
 }
 
+// guesses the profile a ROM was written for from its file extension
+int profileForRom(const char *path)
+{
+    size_t len = strlen(path);
+    if (len >= 4 && strcmp(path + len - 4, ".xo8") == 0)
+    {
+        return PROFILE_XOCHIP;
+    }
+    return PROFILE_SCHIP;
+}
+
+static const char *profileNames[PROFILE_COUNT] = {"vip", "chip48", "schip", "xochip"};
+
+// returns -1 for an unknown name
+int profileFromName(const char *name)
+{
+    for (int p = 0; p < PROFILE_COUNT; p++)
+    {
+        if (strcmp(name, profileNames[p]) == 0)
+        {
+            return p;
+        }
+    }
+    return -1;
+}
+
+// Hash of the whole machine state: registers, stack, timers, memory,
+// keypad and the screen as displayHash sees it. Two runs that hash the
+// same are, for any test, in the same state.
+uint64_t chipHash(const Chip *c)
+{
+    uint64_t h = hashValue(HASH_SEED, displayHash(c->display), 8);
+    h = hashValue(h, c->pc, 2);
+    h = hashValue(h, c->i, 2);
+    h = hashValue(h, c->sp, 2);
+    for (int k = 0; k < STACK_SIZE; k++)
+    {
+        h = hashValue(h, c->stack[k], 2);
+    }
+    for (int k = 0; k < 16; k++)
+    {
+        h = hashValue(h, c->v[k], 1);
+        h = hashValue(h, c->flags[k], 1);
+        h = hashValue(h, c->pattern[k], 1);
+        h = hashValue(h, c->keypad->pad[k], 1);
+    }
+    h = hashValue(h, c->delayTimer, 1);
+    h = hashValue(h, c->soundTimer, 1);
+    h = hashValue(h, c->pitch, 1);
+    h = hashValue(h, c->exited, 1);
+    h = hashValue(h, c->fault, 1);
+    h = hashValue(h, (unsigned char)c->waitKey, 1);
+    h = hashValue(h, c->rng, 4);
+    h = hashValue(h, c->frame, 8);
+    for (unsigned int addr = 0; addr < c->memSize; addr++)
+    {
+        h = hashValue(h, c->mem[addr], 1);
+    }
+    return h;
+}
+
+// indexed by FAULT_
+static const char *faultNames[] = {"none", "stack overflow", "stack underflow"};
+
+const char *faultName(int fault)
+{
+    return fault >= 0 && fault < (int)(sizeof(faultNames) / sizeof(faultNames[0])) ? faultNames[fault] : "unknown";
+}
+
+// copies the whole machine state between two chips of the same profile,
+// leaving the trace and debugger of dst alone
+void copyChip(Chip *dst, const Chip *src)
+{
+    memcpy(dst->mem, src->mem, src->memSize);
+    memcpy(dst->v, src->v, V_REGS_SIZE);
+    memcpy(dst->stack, src->stack, STACK_SIZE * sizeof(short));
+    memcpy(dst->flags, src->flags, sizeof(src->flags));
+    memcpy(dst->pattern, src->pattern, sizeof(src->pattern));
+    memcpy(dst->keypad->pad, src->keypad->pad, 16);
+    dst->keypad->keyPress = src->keypad->keyPress;
+    *dst->display = *src->display;
+    dst->pc = src->pc;
+    dst->i = src->i;
+    dst->sp = src->sp;
+    dst->delayTimer = src->delayTimer;
+    dst->soundTimer = src->soundTimer;
+    dst->updateCounter = src->updateCounter;
+    dst->pitch = src->pitch;
+    dst->exited = src->exited;
+    dst->fault = src->fault;
+    dst->waitKey = src->waitKey;
+    dst->timing = src->timing;
+    dst->cycleBudget = src->cycleBudget;
+    dst->frame = src->frame;
+    dst->instructions = src->instructions;
+    dst->rng = src->rng;
+}
+
+void destroyChip(Chip *c)
+{
+    if (c == NULL)
+    {
+        return;
+    }
+    destroyTrace(c->trace);
+    free(c->debug);
+    free(c->display);
+    free(c->keypad->pad);
+    free(c->keypad);
+    free(c->stack);
+    free(c->v);
+    free(c->mem);
+    free(c);
+}
+
 void loadRom(FILE *fpin, Chip *c)
 {
     if (fpin == NULL)
@@ -67,277 +234,473 @@ void loadRom(FILE *fpin, Chip *c)
         return;
     }
     // load rom to memory starting from 0x200
-    char *b = malloc(sizeof(char));
-    int i = 0;
+    fread(c->mem + 0x200, 1, c->memSize - 0x200, fpin);
+    fclose(fpin);
+}
 
-    while (fread(b, 1, 1, fpin) != 0)
+// loadRom from memory; anything past the end of Chip.mem is dropped
+void loadRomBuffer(const unsigned char *rom, size_t size, Chip *c)
+{
+    if (size > c->memSize - 0x200)
     {
-        c->mem[0x200 + i] = *b;
-        i++;
+        size = c->memSize - 0x200;
     }
-    fclose(fpin);
+    memcpy(c->mem + 0x200, rom, size);
+}
+
+// a byte of memory with the address wrapped, for the helpers below that
+// look ahead of the interpreter
+static inline unsigned char peek(const Chip *c, unsigned int addr)
+{
+    return c->mem[addr & (c->memSize - 1)];
 }
 
-void cycle(Chip *c)
+// xorshift32, so a run is reproducible from its seed
+static inline unsigned char nextRandom(Chip *c)
 {
+    uint32_t r = c->rng;
+    r ^= r << 13;
+    r ^= r >> 17;
+    r ^= r << 5;
+    c->rng = r;
+    return r >> 24;
+}
 
-    unsigned short opcode = c->mem[c->pc] << 8 | c->mem[c->pc + 1];
+// Recognises a loop the CPU has just jumped back to the start of that can
+// only be left once a timer ticks: a jump to itself, or the delay polling
+//   A:   FX07         VX := delay
+//   A+2: 3XNN / 4XNN  skip the jump back when VX == NN / VX != NN
+//   A+4: 1A
+// with the delay timer at a value that keeps it looping. jumpPc is the
+// address of the instruction that just ran. Returns the number of
+// instructions in the loop, 0 if it is not such a loop.
+static inline int idleLoop(const Chip *c, unsigned short jumpPc)
+{
+    unsigned short a = c->pc;
+    if ((peek(c, jumpPc) >> 4) != 0x1 || ((peek(c, jumpPc) & 0xF) << 8 | peek(c, jumpPc + 1)) != a)
+    {
+        return 0;
+    }
+    if (jumpPc == a)
+    {
+        return 1;
+    }
+    if (jumpPc != a + 4 || (peek(c, a) >> 4) != 0xF || peek(c, a + 1) != 0x07)
+    {
+        return 0;
+    }
+    int x = peek(c, a) & 0xF;
+    if (peek(c, a + 2) == (0x30 | x))
+    {
+        return c->delayTimer != peek(c, a + 3) ? 3 : 0;
+    }
+    if (peek(c, a + 2) == (0x40 | x))
+    {
+        return c->delayTimer == peek(c, a + 3) ? 3 : 0;
+    }
+    return 0;
+}
 
-    c->pc = c->pc + 2;
-    int x,
-        y;
-    unsigned short newAddr;
-    switch (opcode & 0xF000)
+// the state after more passes through a loop found by idleLoop
+static inline void idleLoopPasses(Chip *c, int length)
+{
+    if (length == 3)
     {
-    case 0x0000:
-        if (opcode == 0x00E0)
-        {
-            // clear screen
-            for (int i = 0; i < DISPLAY_WIDTH * DISPLAY_HEIGHT; i++)
-            {
-                c->display->pixels[i] = 0;
-            }
-        }
-        else if (opcode == 0x00EE)
-        {
-            // return from subroutine
-            c->sp--;
-            c->pc = c->stack[c->sp];
-        }
-        break;
-    case 0x1000:
-        // jump
-        newAddr = 0x0FFF & opcode;
-        c->pc = newAddr;
-        break;
-    case 0x2000:
-        // subroutine jump
-
-        // push current pc to stack;
-        c->stack[c->sp] = c->pc;
-        c->sp++;
-
-        newAddr = 0x0FFF & opcode;
-        c->pc = newAddr;
-        break;
-    case 0x3000:
-        // Skip if VX == NN
-        if (c->v[(opcode & 0x0F00) >> 8] == (opcode & 0x00FF))
-        {
-            c->pc += 2;
-        }
-        break;
-    case 0x4000:
-        // Skip if VX != NN
-        if (c->v[(opcode & 0x0F00) >> 8] != (opcode & 0x00FF))
-        {
-            c->pc += 2;
-        }
-        break;
-    case 0x5000:
-        // Skip if VX == VY
-        if (c->v[(opcode & 0x0F00) >> 8] == c->v[(opcode & 0x00F0) >> 4])
+        c->v[peek(c, c->pc) & 0xF] = c->delayTimer;
+    }
+}
+
+// debug instantiations: whether to stop before the instruction at the PC
+static inline int debugBreak(Chip *c)
+{
+    Debug *d = c->debug;
+    if (d->steps == 0)
+    {
+        d->stopped = DEBUG_STEP;
+        return 1;
+    }
+    if (!d->resumed && debugTest(d->breakpoints, c->pc))
+    {
+        d->stopped = DEBUG_BREAKPOINT;
+        return 1;
+    }
+    d->resumed = 0;
+    if (d->steps > 0)
+    {
+        d->steps--;
+    }
+    return 0;
+}
+
+// debug instantiations: stop after a store of count bytes at addr if it
+// hits a watched address
+static inline void debugStore(Chip *c, unsigned int addr, int count)
+{
+    for (int k = 0; k < count; k++)
+    {
+        unsigned int a = (addr + k) & (c->memSize - 1);
+        if (debugTest(c->debug->watchpoints, a))
         {
-            c->pc += 2;
+            c->debug->stopped = DEBUG_WATCHPOINT;
+            c->debug->watchAddress = a;
         }
-        break;
-    case 0x6000:
-        // set VX to NN
-        c->v[(opcode & 0x0F00) >> 8] = opcode & 0x00FF;
-        break;
-    case 0x7000:
-        // add NN to VX
-        c->v[(opcode & 0x0F00) >> 8] += opcode & 0x00FF;
-        break;
-    case 0x8000:
-        x = (opcode & 0x0F00) >> 8;
-        y = (opcode & 0x00F0) >> 4;
-        switch (opcode & 0x000F)
-        {
-        case 0:
-            // VX = VY
-            c->v[x] = c->v[y];
-            break;
-        case 1:
-            // VX = VX OR VY
-            c->v[x] = c->v[x] | c->v[y];
-            break;
-        case 2:
-            // VX = VX AND VY
-            c->v[x] = c->v[x] & c->v[y];
-            break;
-        case 3:
-            // VX = VX XOR VY
-            c->v[x] = c->v[x] ^ c->v[y];
-            break;
-        case 4:
-            // VX = VX + VY, VF = carry
-            c->v[0xF] = (c->v[x] + c->v[y]) >> 8;
-            c->v[x] = (c->v[x] + c->v[y]) & 0xFF;
-            break;
-        case 5:
-            // VX = VX - VY, VF = carry
-            c->v[0xF] = 0;
-            if (c->v[x] >= c->v[y])
-            {
+    }
+}
 
-                c->v[0xF] = 1;
-            }
-            c->v[x] = c->v[x] - c->v[y];
-            break;
-        case 6:
-            // Shift VX right, VF is shifted bit
-            c->v[0xF] = c->v[x] & 1;
-            c->v[x] >>= 1;
-            break;
-        case 7:
-            // VX = VY - VX, VF = carry
-            c->v[0xF] = 0;
-            if (c->v[y] >= c->v[x])
-            {
+// VIP machine cycles for one pass through a loop found by idleLoop
+static int idleLoopCycles(const Chip *c, int length)
+{
+    unsigned short a = c->pc;
+    if (length == 1)
+    {
+        return vipCycles(0x1000 | a, a, a, c->v);
+    }
+    return vipCycles(peek(c, a) << 8 | 0x07, a, a + 2, c->v) +
+           vipCycles(peek(c, a + 2) << 8 | peek(c, a + 3), a + 2, a + 4, c->v) + vipCycles(0x1000 | a, a + 4, a, c->v);
+}
 
-                c->v[0xF] = 1;
-            }
-            c->v[x] = c->v[y] - c->v[x];
-            break;
-        case 0xE:
-            // Shift VX left, VF is shifted bit
-            c->v[0xF] = c->v[x] & 128;
-            c->v[x] <<= 1;
+// COSMAC VIP: VY shifts, I advances, VF reset, no extensions
+#define PROFILE(name) name##Vip
+#define QUIRK_SHIFT_VY 1
+#define QUIRK_INCREMENT_I(x) ((x) + 1)
+#define QUIRK_JUMP_VX 0
+#define QUIRK_VF_RESET 1
+#define QUIRK_WRAP 0
+#define QUIRK_SCHIP 0
+#define QUIRK_XOCHIP 0
+#define PROFILE_MEM_SIZE MEM_SIZE
+#define PROFILE_FLAGS_SIZE 0
+#define PROFILE_DEBUG 0
+#include "cycle.inc"
+#undef PROFILE
+#undef PROFILE_DEBUG
+#define PROFILE(name) name##VipDebug
+#define PROFILE_DEBUG 1
+#include "cycle.inc"
+#undef PROFILE
+#undef QUIRK_SHIFT_VY
+#undef QUIRK_INCREMENT_I
+#undef QUIRK_JUMP_VX
+#undef QUIRK_VF_RESET
+#undef QUIRK_WRAP
+#undef QUIRK_SCHIP
+#undef QUIRK_XOCHIP
+#undef PROFILE_MEM_SIZE
+#undef PROFILE_FLAGS_SIZE
+#undef PROFILE_DEBUG
+
+// CHIP-48: VX shifts, I advances by X, BXNN
+#define PROFILE(name) name##Chip48
+#define QUIRK_SHIFT_VY 0
+#define QUIRK_INCREMENT_I(x) (x)
+#define QUIRK_JUMP_VX 1
+#define QUIRK_VF_RESET 0
+#define QUIRK_WRAP 0
+#define QUIRK_SCHIP 0
+#define QUIRK_XOCHIP 0
+#define PROFILE_MEM_SIZE MEM_SIZE
+#define PROFILE_FLAGS_SIZE 0
+#define PROFILE_DEBUG 0
+#include "cycle.inc"
+#undef PROFILE
+#undef PROFILE_DEBUG
+#define PROFILE(name) name##Chip48Debug
+#define PROFILE_DEBUG 1
+#include "cycle.inc"
+#undef PROFILE
+#undef QUIRK_SHIFT_VY
+#undef QUIRK_INCREMENT_I
+#undef QUIRK_JUMP_VX
+#undef QUIRK_VF_RESET
+#undef QUIRK_WRAP
+#undef QUIRK_SCHIP
+#undef QUIRK_XOCHIP
+#undef PROFILE_MEM_SIZE
+#undef PROFILE_FLAGS_SIZE
+#undef PROFILE_DEBUG
+
+// SUPER-CHIP 1.1: VX shifts, I unchanged, BXNN, hi-res
+#define PROFILE(name) name##Schip
+#define QUIRK_SHIFT_VY 0
+#define QUIRK_INCREMENT_I(x) 0
+#define QUIRK_JUMP_VX 1
+#define QUIRK_VF_RESET 0
+#define QUIRK_WRAP 0
+#define QUIRK_SCHIP 1
+#define QUIRK_XOCHIP 0
+#define PROFILE_MEM_SIZE MEM_SIZE
+#define PROFILE_FLAGS_SIZE FLAGS_SIZE
+#define PROFILE_DEBUG 0
+#include "cycle.inc"
+#undef PROFILE
+#undef PROFILE_DEBUG
+#define PROFILE(name) name##SchipDebug
+#define PROFILE_DEBUG 1
+#include "cycle.inc"
+#undef PROFILE
+#undef QUIRK_SHIFT_VY
+#undef QUIRK_INCREMENT_I
+#undef QUIRK_JUMP_VX
+#undef QUIRK_VF_RESET
+#undef QUIRK_WRAP
+#undef QUIRK_SCHIP
+#undef QUIRK_XOCHIP
+#undef PROFILE_MEM_SIZE
+#undef PROFILE_FLAGS_SIZE
+#undef PROFILE_DEBUG
+
+// XO-CHIP: VY shifts, I advances, sprites wrap, 64 KB
+#define PROFILE(name) name##Xochip
+#define QUIRK_SHIFT_VY 1
+#define QUIRK_INCREMENT_I(x) ((x) + 1)
+#define QUIRK_JUMP_VX 0
+#define QUIRK_VF_RESET 0
+#define QUIRK_WRAP 1
+#define QUIRK_SCHIP 1
+#define QUIRK_XOCHIP 1
+#define PROFILE_MEM_SIZE XO_MEM_SIZE
+#define PROFILE_FLAGS_SIZE XO_FLAGS_SIZE
+#define PROFILE_DEBUG 0
+#include "cycle.inc"
+#undef PROFILE
+#undef PROFILE_DEBUG
+#define PROFILE(name) name##XochipDebug
+#define PROFILE_DEBUG 1
+#include "cycle.inc"
+#undef PROFILE
+#undef QUIRK_SHIFT_VY
+#undef QUIRK_INCREMENT_I
+#undef QUIRK_JUMP_VX
+#undef QUIRK_VF_RESET
+#undef QUIRK_WRAP
+#undef QUIRK_SCHIP
+#undef QUIRK_XOCHIP
+#undef PROFILE_MEM_SIZE
+#undef PROFILE_FLAGS_SIZE
+#undef PROFILE_DEBUG
+
+// indexed by Chip.profile
+static void (*const cycles[PROFILE_COUNT])(Chip *) = {cycleVip, cycleChip48, cycleSchip, cycleXochip};
+static int (*const slices[PROFILE_COUNT])(Chip *, int) = {runSliceVip, runSliceChip48, runSliceSchip, runSliceXochip};
+static void (*const debugCycles[PROFILE_COUNT])(Chip *) = {cycleVipDebug, cycleChip48Debug, cycleSchipDebug,
+                                                           cycleXochipDebug};
+static int (*const debugSlices[PROFILE_COUNT])(Chip *, int) = {runSliceVipDebug, runSliceChip48Debug,
+                                                               runSliceSchipDebug, runSliceXochipDebug};
+
+// executes one instruction, or nothing while halted in FX0A; returns the
+// FAULT_ the CPU is stopped by, FAULT_NONE while it can run
+int cycle(Chip *c)
+{
+    if (c->waitKey < 0)
+    {
+        cycles[c->profile](c);
+    }
+    return c->fault;
+}
+
+void setKey(Chip *c, int key, int down)
+{
+    key &= 0xF;
+    if (c->waitKey >= 0 && !down && c->keypad->pad[key])
+    {
+        // like the VIP, FX0A completes when the key is released
+        c->v[(int)c->waitKey] = key;
+        c->waitKey = -1;
+    }
+    c->keypad->pad[key] = down != 0;
+    if (down)
+    {
+        c->keypad->keyPress = 1;
+    }
+}
+
+// the whole keypad as a bit mask, bit n is key n
+void setPad(Chip *c, unsigned short mask)
+{
+    for (int key = 0; key < 16; key++)
+    {
+        setKey(c, key, mask >> key & 1);
+    }
+}
+
+unsigned short padMask(const Chip *c)
+{
+    unsigned short mask = 0;
+    for (int key = 0; key < 16; key++)
+    {
+        mask |= (c->keypad->pad[key] != 0) << key;
+    }
+    return mask;
+}
+
+void tickTimers(Chip *c)
+{
+    // timers count down at 60 Hz and stop at zero
+    if (c->delayTimer > 0)
+    {
+        c->delayTimer--;
+    }
+    if (c->soundTimer > 0)
+    {
+        c->soundTimer--;
+    }
+}
+
+// runs one frame's worth of VIP machine cycles; an instruction that
+// overruns the frame borrows from the next one. Always inlined with a
+// constant debug, so only debugFrame pays for the breakpoint checks; it
+// returns 0 when the debugger stopped the CPU part way through the frame.
+static inline int runFrameVip(Chip *c, int debug)
+{
+    if (!debug || !c->debug->midFrame)
+    {
+        c->cycleBudget += VIP_CYCLES_PER_FRAME - VIP_INTERRUPT_CYCLES;
+    }
+    while (c->cycleBudget > 0 && !c->exited && !c->fault)
+    {
+        if (c->waitKey >= 0)
+        {
+            // halted in FX0A, nothing runs until the next key release
+            c->cycleBudget = 0;
             break;
         }
-        break;
-    case 0x9000:
-        // Skip if VX != VY
-        if (c->v[(opcode & 0x0F00) >> 8] != c->v[(opcode & 0x00F0) >> 4])
+        if (debug && debugBreak(c))
+        {
+            return 0;
+        }
+        unsigned short pc = c->pc;
+        unsigned short opcode = peek(c, pc) << 8 | peek(c, pc + 1);
+        (debug ? debugCycles : cycles)[c->profile](c);
+        c->instructions++;
+        c->cycleBudget -= vipCycles(opcode, pc, c->pc, c->v);
+        if (debug && c->debug->stopped)
         {
-            c->pc += 2;
+            return 0;
         }
-        break;
-    case 0xA000:
-        // set I to NNN
-        c->i = opcode & 0x0FFF;
-        break;
-    case 0xB000:
-        // Jump to NNN
-        c->pc = opcode & 0x0FFF;
-        break;
-    case 0xC000:
-        // Set VX to random number AND NN
-        c->v[(opcode & 0x0F00) >> 8] = (rand() % 256) & (0x00FF & opcode);
-        break;
-    case 0xD000:
-        x = c->v[(opcode & 0x0F00) >> 8] % DISPLAY_WIDTH;
-        y = c->v[(opcode & 0x00F0) >> 4] % DISPLAY_HEIGHT;
-        int n = opcode & 0x000F;
-        char collision = 0;
-        Display *d = c->display;
-
-        // loads n bytes (as n 8-pixel rows)
-        for (int i = 0; i < n; i++)
+        if (!debug && c->pc <= pc && c->trace == NULL && c->cycleBudget > 0)
         {
-            unsigned char row = c->mem[c->i + i];
-            if (i + y >= DISPLAY_HEIGHT)
-                break;
-            // iterating y coordinates
-            for (int j = 0; j < 8; j++)
+            // as in runSlice, skip the passes through an idle loop that
+            // still fit in the frame
+            int length = idleLoop(c, pc);
+            if (length > 0)
             {
-                if (j + x >= DISPLAY_WIDTH)
-                    break;
-                // iterating x coordinates
-                unsigned char pixelOn = row & (0x80 >> j);
-                if (pixelOn == 0)
-                    continue;
-
-                int pixelIdx = (x + j) + 64 * (y + i);
-                d->drawFlag = 1;
-                if (d->pixels[pixelIdx] == 1)
+                int cost = idleLoopCycles(c, length);
+                int passes = (c->cycleBudget - 1) / cost;
+                if (passes > 0)
                 {
-                    collision = 1;
-                    d->pixels[pixelIdx] = 0;
-                }
-                else
-                {
-                    d->pixels[pixelIdx] = 1;
+                    idleLoopPasses(c, length);
+                    c->cycleBudget -= passes * cost;
                 }
             }
         }
-        // set VF to collision
-        c->v[0xF] = collision;
-        break;
-    case 0xE000:
-        switch (opcode & 0xFF)
+        if ((opcode & 0xF000) == 0xD000)
         {
-        case 0x9E:
-            if (c->keypad->pad[c->v[(opcode & 0x0F00) >> 8]] == 1)
-            {
-                c->pc += 2;
-            }
-            break;
-        case 0xA1:
-            if (c->keypad->pad[c->v[(opcode & 0x0F00) >> 8]] == 0)
+            // the VIP draws after waiting for the vertical blank interrupt,
+            // so the rest of the frame is spent waiting
+            if (c->cycleBudget > 0)
             {
-                c->pc += 2;
+                c->cycleBudget = 0;
             }
             break;
         }
-        break;
-    case 0xF000:
-        x = (opcode & 0x0F00) >> 8;
-        switch (opcode & 0x00FF)
+    }
+    return 1;
+}
+
+// runs one 60 Hz frame: a slice of instructions followed by a timer tick.
+// In VIP timing the slice is bounded by machine cycles instead. Returns
+// the FAULT_ the CPU is stopped by, like cycle.
+int runFrame(Chip *c, int instructions)
+{
+    if (c->timing == TIMING_VIP)
+    {
+        runFrameVip(c, 0);
+        tickTimers(c);
+        c->frame++;
+        return c->fault;
+    }
+
+    // the profile is resolved once per frame, not per instruction
+    runInstructions(c, instructions, 0);
+    tickTimers(c);
+    c->frame++;
+    return c->fault;
+}
+
+// runs up to count instructions of the current FAST timing frame without
+// ending it, through the specialised interpreter or, with debug, the debug
+// one (which needs attachDebug). Returns how many ran, fewer when halted
+// in FX0A. For harnesses that compare state part way through a frame.
+int runInstructions(Chip *c, int count, int debug)
+{
+    if (c->waitKey >= 0)
+    {
+        return 0;
+    }
+    return (debug ? debugSlices : slices)[c->profile](c, count);
+}
+
+// advances time by whole frames without running any instructions, as if
+// runFrame had been called while halted in FX0A
+void skipFrames(Chip *c, uint64_t frames)
+{
+    c->delayTimer = frames < c->delayTimer ? c->delayTimer - frames : 0;
+    c->soundTimer = frames < c->soundTimer ? c->soundTimer - frames : 0;
+    if (c->timing == TIMING_VIP)
+    {
+        // a debt left by the last instruction is paid off first
+        long long budget = c->cycleBudget + (long long)frames * (VIP_CYCLES_PER_FRAME - VIP_INTERRUPT_CYCLES);
+        c->cycleBudget = budget > 0 ? 0 : budget;
+    }
+    c->frame += frames;
+}
+
+// gives the chip a debugger with no breakpoints, for debugFrame
+Debug *attachDebug(Chip *c)
+{
+    if (c->debug == NULL)
+    {
+        c->debug = calloc(1, sizeof(Debug));
+        if (c->debug != NULL)
         {
-        case 0x07:
-            c->v[x] = c->delayTimer;
-            break;
-        case 0x15:
-            c->delayTimer = c->v[x];
-            break;
-        case 0x18:
-            c->soundTimer = c->v[x];
-            break;
-        case 0x1E:
-            c->v[0xF] = (c->v[x] + c->i) / 4096;
-            c->i = (c->i + c->v[x]) % 4096;
-            break;
-        case 0x0A:
-            // find which key was pressed
+            c->debug->steps = -1;
+        }
+    }
+    return c->debug;
+}
 
-            for (int i = 0; i < 16; i++)
-            {
-                if (c->keypad->pad[i] == 1)
-                {
+// runFrame through the debug interpreters, which stop at breakpoints,
+// watchpoints and after Debug.steps instructions. Returns 1 when the frame
+// finished, 0 when the CPU stopped part way; Debug.stopped says why and
+// calling it again carries on from there.
+int debugFrame(Chip *c, int instructions)
+{
+    Debug *d = c->debug;
+    // the instruction a breakpoint or step stopped in front of runs now
+    d->resumed = d->stopped == DEBUG_BREAKPOINT || d->stopped == DEBUG_STEP;
+    d->stopped = DEBUG_RUNNING;
 
-                    c->v[(opcode & 0x0F00) >> 8] = i;
-                    c->pc += 2;
-                    break;
-                }
-            }
-            c->pc -= 2;
-            break;
-        case 0x29:
-            c->i = (c->v[x] & 0xF) * 5 + 0x50;
-            break;
-        case 0x55:
-            // load V0-VX (inclusive) to memory at i..i+x
-            for (int i = 0; i < x + 1; i++)
-            {
-                c->mem[c->i + i] = c->v[i];
-            }
-            break;
-        case 0x33:
-            // decimal conversion
-            c->mem[c->i] = c->v[x] / 100;
-            c->mem[c->i + 1] = (c->v[x] / 10) % 10;
-            c->mem[c->i + 2] = c->v[x] % 10;
-            break;
-        case 0x65:
-            // load V0-VX (inclusive) from memory at i..i+x
-            for (int i = 0; i < x + 1; i++)
-            {
-                c->v[i] = c->mem[c->i + i];
-            }
-            break;
+    int finished;
+    if (c->timing == TIMING_VIP)
+    {
+        finished = runFrameVip(c, 1);
+    }
+    else
+    {
+        if (c->waitKey < 0)
+        {
+            d->executed += debugSlices[c->profile](c, instructions - d->executed);
         }
-        break;
+        finished = d->stopped == DEBUG_RUNNING;
     }
-}
\ No newline at end of file
+    if (!finished)
+    {
+        d->midFrame = 1;
+        return 0;
+    }
+    d->midFrame = 0;
+    d->executed = 0;
+    tickTimers(c);
+    c->frame++;
+    return 1;
+}
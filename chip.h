@@ -1,10 +1,25 @@
+#ifndef CHIP_H
+#define CHIP_H
+
 #include <stdio.h>
-typedef struct
-{
-    int updateCounter;
-    unsigned char *pixels;
-    char drawFlag;
-} Display;
+#include "display.h"
+#include "trace.h"
+#include "debug.h"
+
+// quirk profiles, each runs its own interpreter specialised at compile time
+#define PROFILE_VIP 0    // COSMAC VIP CHIP-8
+#define PROFILE_CHIP48 1 // HP-48 CHIP-48
+#define PROFILE_SCHIP 2  // SUPER-CHIP 1.1, the default
+#define PROFILE_XOCHIP 3 // XO-CHIP, 64 KB, four colours, audio patterns
+#define PROFILE_COUNT 4
+
+// why the CPU stopped for good, Chip.fault
+#define FAULT_NONE 0
+#define FAULT_STACK_OVERFLOW 1  // 2NNN with all 16 stack entries in use
+#define FAULT_STACK_UNDERFLOW 2 // 00EE with nothing on the stack
+
+#define TIMING_FAST 0 // a fixed number of instructions per frame
+#define TIMING_VIP 1  // instructions charged their COSMAC VIP cycle cost
 
 typedef struct
 {
@@ -14,6 +29,8 @@ typedef struct
 
 typedef struct
 {
+    int profile;
+    unsigned int memSize;
     unsigned char *mem;
     unsigned char *v;
     unsigned short pc;
@@ -23,10 +40,42 @@ typedef struct
     unsigned char delayTimer;
     unsigned char soundTimer;
     int updateCounter;
+    unsigned char flags[16];   // SUPER-CHIP RPL user flags, FX75/FX85
+    unsigned char pattern[16]; // XO-CHIP audio pattern buffer, F002
+    unsigned char pitch;       // XO-CHIP pattern playback pitch, FX3A
+    char exited;             // set by the SUPER-CHIP 00FD exit instruction
+    char fault;              // FAULT_ that stopped the CPU on the faulting instruction
+    signed char waitKey;     // register FX0A is loading while halted for a key, -1 when running
+    char timing;             // TIMING_FAST or TIMING_VIP
+    int cycleBudget;         // VIP machine cycles left in this frame, may run negative
+    uint64_t frame;          // frames run since power-on
+    uint64_t instructions;   // run by runFrame and runInstructions, skipped idle-loop passes not counted
+    uint32_t rng;            // CXNN random state, never 0; seed it for a reproducible run
     Keypad *keypad;
     Display *display;
+    Trace *trace; // execution trace, NULL when tracing is off
+    Debug *debug; // breakpoints for debugFrame, NULL unless attached
 } Chip;
 
 void loadRom(FILE *fpin, Chip *c);
-void cycle(Chip *c);
-Chip *createChip();
\ No newline at end of file
+void loadRomBuffer(const unsigned char *rom, size_t size, Chip *c);
+int cycle(Chip *c);
+void tickTimers(Chip *c);
+int runFrame(Chip *c, int instructions);
+int runInstructions(Chip *c, int count, int debug);
+void skipFrames(Chip *c, uint64_t frames);
+Chip *createChip();
+Chip *createMachine(int profile);
+int profileForRom(const char *path);
+int profileFromName(const char *name);
+const char *faultName(int fault);
+void setKey(Chip *c, int key, int down);
+void setPad(Chip *c, unsigned short mask);
+unsigned short padMask(const Chip *c);
+void copyChip(Chip *dst, const Chip *src);
+uint64_t chipHash(const Chip *c);
+void destroyChip(Chip *c);
+Debug *attachDebug(Chip *c);
+int debugFrame(Chip *c, int instructions);
+
+#endif
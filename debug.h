@@ -0,0 +1,48 @@
+#ifndef DEBUG_H
+#define DEBUG_H
+
+#include <stdint.h>
+
+// why the CPU stopped under debugFrame
+#define DEBUG_RUNNING 0
+#define DEBUG_BREAKPOINT 1 // before an instruction with a breakpoint
+#define DEBUG_WATCHPOINT 2 // after a store to a watched address
+#define DEBUG_STEP 3       // the requested number of instructions ran
+
+#define DEBUG_ADDRESSES 65536 // enough for XO-CHIP memory
+
+// Breakpoints and watchpoints, one bit per address. Only the debug
+// instantiations of the interpreter behind debugFrame look at them, so
+// runFrame and cycle pay nothing for them.
+typedef struct
+{
+    uint8_t breakpoints[DEBUG_ADDRESSES / 8]; // stop before executing the address
+    uint8_t watchpoints[DEBUG_ADDRESSES / 8]; // stop after FX55, FX33 or 5XY2 stores to it
+    int stopped;                              // DEBUG_ reason for the last stop
+    unsigned int watchAddress;                // the watched address written, for DEBUG_WATCHPOINT
+    long steps;                               // instructions to run before stopping, -1 for no limit
+    int resumed;                              // the next instruction runs even if it has a breakpoint
+    int executed;                             // instructions run of the frame that stopped part way
+    int midFrame;                             // a frame stopped part way and has not finished
+} Debug;
+
+static inline int debugTest(const uint8_t *map, unsigned int addr)
+{
+    addr &= DEBUG_ADDRESSES - 1;
+    return map[addr >> 3] >> (addr & 7) & 1;
+}
+
+static inline void debugSet(uint8_t *map, unsigned int addr, int on)
+{
+    addr &= DEBUG_ADDRESSES - 1;
+    if (on)
+    {
+        map[addr >> 3] |= 1 << (addr & 7);
+    }
+    else
+    {
+        map[addr >> 3] &= ~(1 << (addr & 7));
+    }
+}
+
+#endif
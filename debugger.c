@@ -0,0 +1,309 @@
+#include "chip.h"
+#include "disasm.h"
+#include "net.h"
+#include <ctype.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Interactive debugger.
+//
+//   debugger [--ipf N] [--profile NAME] [--timing vip] [--listen PORT] rom
+//
+// Reads commands from stdin, or from one client connecting to PORT on
+// the loopback interface with --listen. The ROM runs through debugFrame,
+// the debug instantiation of the interpreter; type "help" for commands.
+
+#define INSTRUCTIONS_PER_FRAME 12
+#define LINE_SIZE 256
+
+static volatile sig_atomic_t interrupted = 0;
+
+static void interrupt(int sig)
+{
+    interrupted = 1;
+}
+
+static const char *help =
+    "break ADDR        stop before executing ADDR (b)\n"
+    "delete ADDR       remove a breakpoint (d)\n"
+    "watch ADDR [LEN]  stop after FX55/FX33/5XY2 store to ADDR (w)\n"
+    "unwatch ADDR [LEN]\n"
+    "step [N]          run N instructions (s)\n"
+    "continue          run until a breakpoint, watchpoint or FX0A (c)\n"
+    "frame [N]         run N frames (f)\n"
+    "regs              show registers (r)\n"
+    "list [ADDR [N]]   disassemble N instructions (l)\n"
+    "mem ADDR [N]      dump N bytes (x)\n"
+    "key K 1|0         press or release key K (k)\n"
+    "quit              (q)\n";
+
+static void showInstruction(FILE *out, const Chip *c, unsigned int addr)
+{
+    Instruction ins;
+    disassemble(c->mem, c->memSize, addr, c->profile, &ins);
+    fprintf(out, "%s%04X  %04X  %s\n", addr == c->pc ? "=> " : "   ", addr, ins.opcode, ins.text);
+}
+
+static void showRegisters(FILE *out, const Chip *c)
+{
+    fprintf(out, "PC=%04X I=%04X SP=%X DT=%02X ST=%02X frame=%llu%s\n", c->pc, c->i, c->sp, c->delayTimer,
+            c->soundTimer, (unsigned long long)c->frame, c->waitKey >= 0 ? " (waiting for key)" : "");
+    for (int r = 0; r < 16; r++)
+    {
+        fprintf(out, "V%X=%02X%s", r, c->v[r], r % 8 == 7 ? "\n" : " ");
+    }
+    for (int s = 0; s < c->sp && s < 16; s++)
+    {
+        fprintf(out, "%s%04X", s ? " " : "stack: ", c->stack[s]);
+    }
+    if (c->sp > 0)
+    {
+        fputc('\n', out);
+    }
+}
+
+// runs frames until the CPU stops, leaving it where it stopped; limit is
+// the number of frames to run, -1 for no limit
+static void run(FILE *out, Chip *c, int instructions, long limit)
+{
+    Debug *d = c->debug;
+    interrupted = 0;
+    for (long f = 0; limit < 0 || f < limit; f++)
+    {
+        if (!debugFrame(c, instructions))
+        {
+            if (d->stopped == DEBUG_BREAKPOINT)
+            {
+                fprintf(out, "breakpoint at %04X\n", c->pc);
+            }
+            else if (d->stopped == DEBUG_WATCHPOINT)
+            {
+                fprintf(out, "watchpoint: %04X written, now %02X\n", d->watchAddress, c->mem[d->watchAddress]);
+            }
+            break;
+        }
+        if (c->fault)
+        {
+            fprintf(out, "%s\n", faultName(c->fault));
+            break;
+        }
+        if (c->exited || c->waitKey >= 0 || interrupted)
+        {
+            fprintf(out, "%s\n", c->exited ? "exited" : c->waitKey >= 0 ? "waiting for key" : "interrupted");
+            break;
+        }
+    }
+    d->steps = -1;
+    showInstruction(out, c, c->pc);
+}
+
+// address and count arguments in hex and decimal, both optional
+static int parseArgs(const char *args, unsigned int *addr, long *count)
+{
+    char *end;
+    while (isspace((unsigned char)*args))
+    {
+        args++;
+    }
+    if (*args == 0)
+    {
+        return 0;
+    }
+    *addr = strtoul(args, &end, 16);
+    if (end == args)
+    {
+        return -1;
+    }
+    if (count != NULL && *end != 0)
+    {
+        *count = strtol(end, NULL, 10);
+        return 2;
+    }
+    return 1;
+}
+
+static void command(FILE *out, Chip *c, int instructions, char *line, int *quit)
+{
+    Debug *d = c->debug;
+    char *cmd = strtok(line, " \t\r\n");
+    char *args = strtok(NULL, "\r\n");
+    unsigned int addr = c->pc;
+    long count = 1;
+    int given;
+
+    if (cmd == NULL)
+    {
+        return;
+    }
+    given = parseArgs(args != NULL ? args : "", &addr, &count);
+    if (given < 0)
+    {
+        fprintf(out, "bad address\n");
+    }
+    else if (strcmp(cmd, "b") == 0 || strcmp(cmd, "break") == 0 || strcmp(cmd, "d") == 0 ||
+             strcmp(cmd, "delete") == 0)
+    {
+        debugSet(d->breakpoints, addr, cmd[0] == 'b');
+        fprintf(out, "breakpoint %s %04X\n", cmd[0] == 'b' ? "set at" : "removed from", addr);
+    }
+    else if (strcmp(cmd, "w") == 0 || strcmp(cmd, "watch") == 0 || strcmp(cmd, "unwatch") == 0)
+    {
+        for (long k = 0; k < count; k++)
+        {
+            debugSet(d->watchpoints, addr + k, cmd[0] == 'w');
+        }
+        fprintf(out, "watchpoint %s %04X-%04lX\n", cmd[0] == 'w' ? "set at" : "removed from", addr, addr + count - 1);
+    }
+    else if (strcmp(cmd, "s") == 0 || strcmp(cmd, "step") == 0)
+    {
+        d->steps = given == 1 ? (long)strtoul(args, NULL, 10) : 1;
+        run(out, c, instructions, -1);
+    }
+    else if (strcmp(cmd, "c") == 0 || strcmp(cmd, "continue") == 0)
+    {
+        run(out, c, instructions, -1);
+    }
+    else if (strcmp(cmd, "f") == 0 || strcmp(cmd, "frame") == 0)
+    {
+        run(out, c, instructions, given == 1 ? (long)strtoul(args, NULL, 10) : 1);
+    }
+    else if (strcmp(cmd, "r") == 0 || strcmp(cmd, "regs") == 0)
+    {
+        showRegisters(out, c);
+    }
+    else if (strcmp(cmd, "l") == 0 || strcmp(cmd, "list") == 0)
+    {
+        count = given == 2 ? count : 8;
+        for (long k = 0; k < count && addr < c->memSize; k++)
+        {
+            Instruction ins;
+            showInstruction(out, c, addr);
+            disassemble(c->mem, c->memSize, addr, c->profile, &ins);
+            addr += ins.length;
+        }
+    }
+    else if ((strcmp(cmd, "x") == 0 || strcmp(cmd, "mem") == 0) && given > 0)
+    {
+        count = given == 2 ? count : 16;
+        for (long k = 0; k < count && addr + k < c->memSize; k++)
+        {
+            if (k % 16 == 0)
+            {
+                fprintf(out, "%s%04lX:", k ? "\n" : "", addr + k);
+            }
+            fprintf(out, " %02X", c->mem[addr + k]);
+        }
+        fputc('\n', out);
+    }
+    else if ((strcmp(cmd, "k") == 0 || strcmp(cmd, "key") == 0) && given == 2)
+    {
+        setKey(c, addr, count != 0);
+        fprintf(out, "key %X %s\n", addr & 0xF, count ? "down" : "up");
+    }
+    else if (strcmp(cmd, "q") == 0 || strcmp(cmd, "quit") == 0)
+    {
+        *quit = 1;
+    }
+    else
+    {
+        fputs(help, out);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int instructionsPerFrame = INSTRUCTIONS_PER_FRAME;
+    int profile = -1;
+    int timing = TIMING_FAST;
+    int port = 0;
+    const char *romPath = NULL;
+
+    for (int a = 1; a < argc; a++)
+    {
+        if (strcmp(argv[a], "--ipf") == 0 && a + 1 < argc)
+        {
+            instructionsPerFrame = atoi(argv[++a]);
+        }
+        else if (strcmp(argv[a], "--profile") == 0 && a + 1 < argc)
+        {
+            profile = profileFromName(argv[++a]);
+            if (profile < 0)
+            {
+                fprintf(stderr, "Unknown profile %s\n", argv[a]);
+                return 2;
+            }
+        }
+        else if (strcmp(argv[a], "--timing") == 0 && a + 1 < argc)
+        {
+            timing = strcmp(argv[++a], "vip") == 0 ? TIMING_VIP : TIMING_FAST;
+        }
+        else if (strcmp(argv[a], "--listen") == 0 && a + 1 < argc)
+        {
+            port = atoi(argv[++a]);
+        }
+        else if (argv[a][0] == '-' || romPath != NULL)
+        {
+            romPath = NULL;
+            break;
+        }
+        else
+        {
+            romPath = argv[a];
+        }
+    }
+    if (romPath == NULL)
+    {
+        fprintf(stderr, "usage: debugger [--ipf N] [--profile NAME] [--timing vip] [--listen PORT] rom\n");
+        return 2;
+    }
+
+    FILE *fpin = fopen(romPath, "rb");
+    if (fpin == NULL)
+    {
+        fprintf(stderr, "Error opening ROM %s\n", romPath);
+        return 127;
+    }
+    Chip *chip = createMachine(profile >= 0 ? profile : profileForRom(romPath));
+    chip->timing = timing;
+    loadRom(fpin, chip);
+    if (attachDebug(chip) == NULL)
+    {
+        fprintf(stderr, "Error allocating debugger\n");
+        return 1;
+    }
+
+    FILE *in = stdin, *out = stdout;
+    if (port > 0)
+    {
+        int client = acceptLoopback(port);
+        if (client < 0)
+        {
+            fprintf(stderr, "Error listening on port %d\n", port);
+            return 1;
+        }
+        in = fdopen(client, "r");
+        out = fdopen(dup(client), "w");
+    }
+    setvbuf(out, NULL, _IOLBF, 0);
+    // Ctrl-C stops a continue instead of the debugger
+    signal(SIGINT, interrupt);
+
+    char line[LINE_SIZE];
+    int quit = 0;
+    showInstruction(out, chip, chip->pc);
+    while (!quit)
+    {
+        fprintf(out, "(c8) ");
+        fflush(out);
+        if (fgets(line, sizeof(line), in) == NULL)
+        {
+            break;
+        }
+        command(out, chip, instructionsPerFrame, line, &quit);
+    }
+    destroyChip(chip);
+    return 0;
+}
@@ -0,0 +1,266 @@
+#include "disasm.h"
+#include "chip.h"
+#include <stdarg.h>
+#include <stdio.h>
+
+// Decodes with the same rules as cycle.inc: instructions the profile does
+// not implement execute as no-ops there and come out as data words here.
+
+static void emit(Instruction *ins, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    vsnprintf(ins->text, sizeof(ins->text), format, args);
+    va_end(args);
+    ins->valid = 1;
+}
+
+// control flow and memory writes of a valid instruction
+static void classify(Instruction *ins)
+{
+    unsigned short opcode = ins->opcode;
+    int x = (opcode >> 8) & 0xF, y = (opcode >> 4) & 0xF, n = opcode & 0xF;
+
+    switch (opcode >> 12)
+    {
+    case 0x0:
+        ins->flow = opcode == 0x00EE ? FLOW_RETURN : opcode == 0x00FD ? FLOW_STOP : FLOW_NEXT;
+        break;
+    case 0x1:
+    case 0x2:
+        ins->flow = opcode >> 12 == 0x1 ? FLOW_JUMP : FLOW_CALL;
+        ins->target = opcode & 0xFFF;
+        break;
+    case 0x3:
+    case 0x4:
+    case 0x9:
+    case 0xE:
+        ins->flow = FLOW_SKIP;
+        break;
+    case 0x5:
+        ins->flow = n == 0 ? FLOW_SKIP : FLOW_NEXT;
+        ins->store = n == 2 ? (x > y ? x - y : y - x) + 1 : 0;
+        break;
+    case 0xB:
+        ins->flow = FLOW_INDIRECT;
+        ins->target = opcode & 0xFFF;
+        break;
+    case 0xF:
+        ins->store = (opcode & 0xFF) == 0x55 ? x + 1 : (opcode & 0xFF) == 0x33 ? 3 : 0;
+        break;
+    }
+}
+
+void disassemble(const unsigned char *mem, unsigned int memSize, unsigned int addr, int profile, Instruction *ins)
+{
+    int schip = profile == PROFILE_SCHIP || profile == PROFILE_XOCHIP;
+    int xo = profile == PROFILE_XOCHIP;
+    unsigned short opcode = mem[addr % memSize] << 8 | mem[(addr + 1) % memSize];
+    int x = (opcode >> 8) & 0xF, y = (opcode >> 4) & 0xF, n = opcode & 0xF;
+    int nn = opcode & 0xFF, nnn = opcode & 0xFFF;
+
+    ins->opcode = opcode;
+    ins->operand = 0;
+    ins->length = 2;
+    ins->valid = 0;
+    ins->flow = FLOW_NEXT;
+    ins->target = 0;
+    ins->store = 0;
+    snprintf(ins->text, sizeof(ins->text), "DW   #%04X", opcode);
+
+    switch (opcode >> 12)
+    {
+    case 0x0:
+        if (opcode == 0x00E0)
+        {
+            emit(ins, "CLS");
+        }
+        else if (opcode == 0x00EE)
+        {
+            emit(ins, "RET");
+        }
+        else if ((opcode & 0xFFF0) == 0x00C0 && schip)
+        {
+            emit(ins, "SCD  %d", n);
+        }
+        else if ((opcode & 0xFFF0) == 0x00D0 && xo)
+        {
+            emit(ins, "SCU  %d", n);
+        }
+        else if (opcode == 0x00FB && schip)
+        {
+            emit(ins, "SCR");
+        }
+        else if (opcode == 0x00FC && schip)
+        {
+            emit(ins, "SCL");
+        }
+        else if (opcode == 0x00FD && schip)
+        {
+            emit(ins, "EXIT");
+        }
+        else if (opcode == 0x00FE && schip)
+        {
+            emit(ins, "LOW");
+        }
+        else if (opcode == 0x00FF && schip)
+        {
+            emit(ins, "HIGH");
+        }
+        break;
+    case 0x1:
+        emit(ins, "JP   #%03X", nnn);
+        break;
+    case 0x2:
+        emit(ins, "CALL #%03X", nnn);
+        break;
+    case 0x3:
+        emit(ins, "SE   V%X, #%02X", x, nn);
+        break;
+    case 0x4:
+        emit(ins, "SNE  V%X, #%02X", x, nn);
+        break;
+    case 0x5:
+        if (n == 0)
+        {
+            emit(ins, "SE   V%X, V%X", x, y);
+        }
+        else if (n == 2 && xo)
+        {
+            emit(ins, "SAVE V%X - V%X", x, y);
+        }
+        else if (n == 3 && xo)
+        {
+            emit(ins, "LOAD V%X - V%X", x, y);
+        }
+        break;
+    case 0x6:
+        emit(ins, "LD   V%X, #%02X", x, nn);
+        break;
+    case 0x7:
+        emit(ins, "ADD  V%X, #%02X", x, nn);
+        break;
+    case 0x8:
+    {
+        static const char *const alu[16] = {"LD", "OR", "AND", "XOR", "ADD", "SUB", "SHR", "SUBN",
+                                            NULL, NULL, NULL, NULL, NULL, NULL, "SHL", NULL};
+        if (alu[n] != NULL)
+        {
+            emit(ins, "%-4s V%X, V%X", alu[n], x, y);
+        }
+        break;
+    }
+    case 0x9:
+        emit(ins, "SNE  V%X, V%X", x, y);
+        break;
+    case 0xA:
+        emit(ins, "LD   I, #%03X", nnn);
+        break;
+    case 0xB:
+        if (profile == PROFILE_CHIP48 || profile == PROFILE_SCHIP)
+        {
+            emit(ins, "JP   V%X, #%03X", x, nnn);
+        }
+        else
+        {
+            emit(ins, "JP   V0, #%03X", nnn);
+        }
+        break;
+    case 0xC:
+        emit(ins, "RND  V%X, #%02X", x, nn);
+        break;
+    case 0xD:
+        emit(ins, "DRW  V%X, V%X, %d", x, y, n);
+        break;
+    case 0xE:
+        if (nn == 0x9E)
+        {
+            emit(ins, "SKP  V%X", x);
+        }
+        else if (nn == 0xA1)
+        {
+            emit(ins, "SKNP V%X", x);
+        }
+        break;
+    case 0xF:
+        switch (nn)
+        {
+        case 0x00:
+            if (opcode == 0xF000 && xo)
+            {
+                ins->operand = mem[(addr + 2) % memSize] << 8 | mem[(addr + 3) % memSize];
+                ins->length = 4;
+                emit(ins, "LD   I, #%04X", ins->operand);
+            }
+            break;
+        case 0x01:
+            if (xo)
+            {
+                emit(ins, "PLANE %d", x & 3);
+            }
+            break;
+        case 0x02:
+            if (opcode == 0xF002 && xo)
+            {
+                emit(ins, "AUDIO");
+            }
+            break;
+        case 0x3A:
+            if (xo)
+            {
+                emit(ins, "PITCH V%X", x);
+            }
+            break;
+        case 0x07:
+            emit(ins, "LD   V%X, DT", x);
+            break;
+        case 0x0A:
+            emit(ins, "LD   V%X, K", x);
+            break;
+        case 0x15:
+            emit(ins, "LD   DT, V%X", x);
+            break;
+        case 0x18:
+            emit(ins, "LD   ST, V%X", x);
+            break;
+        case 0x1E:
+            emit(ins, "ADD  I, V%X", x);
+            break;
+        case 0x29:
+            emit(ins, "LD   F, V%X", x);
+            break;
+        case 0x30:
+            if (schip)
+            {
+                emit(ins, "LD   HF, V%X", x);
+            }
+            break;
+        case 0x33:
+            emit(ins, "LD   B, V%X", x);
+            break;
+        case 0x55:
+            emit(ins, "LD   [I], V%X", x);
+            break;
+        case 0x65:
+            emit(ins, "LD   V%X, [I]", x);
+            break;
+        case 0x75:
+            if (schip)
+            {
+                emit(ins, "LD   R, V%X", x);
+            }
+            break;
+        case 0x85:
+            if (schip)
+            {
+                emit(ins, "LD   V%X, R", x);
+            }
+            break;
+        }
+        break;
+    }
+    if (ins->valid)
+    {
+        classify(ins);
+    }
+}
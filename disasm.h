@@ -0,0 +1,30 @@
+#ifndef DISASM_H
+#define DISASM_H
+
+#include <stddef.h>
+
+// how an instruction passes control on
+#define FLOW_NEXT 0     // to the following instruction
+#define FLOW_JUMP 1     // to target only
+#define FLOW_CALL 2     // to target, returning to the following instruction
+#define FLOW_RETURN 3   // to the address on the stack
+#define FLOW_SKIP 4     // to the following instruction or the one after it
+#define FLOW_INDIRECT 5 // to target plus a register, BNNN
+#define FLOW_STOP 6     // nowhere, the SUPER-CHIP exit
+
+// one decoded instruction
+typedef struct
+{
+    unsigned short opcode;
+    unsigned short operand; // the second word of XO-CHIP F000 NNNN
+    int length;             // in bytes, 4 for F000 NNNN, otherwise 2
+    int valid;              // the profile's interpreter implements it
+    int flow;               // FLOW_
+    unsigned int target;    // jump, call or indirect jump base address
+    int store;              // bytes written to memory at I, 0 for none
+    char text[32];          // mnemonic, or DW for anything the profile ignores
+} Instruction;
+
+void disassemble(const unsigned char *mem, unsigned int memSize, unsigned int addr, int profile, Instruction *ins);
+
+#endif
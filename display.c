@@ -0,0 +1,156 @@
+#include "display.h"
+#include <string.h>
+
+const uint8_t displayPalette[4][3] = {{0, 0, 0}, {255, 255, 255}, {255, 102, 0}, {102, 34, 0}};
+
+void clearDisplay(Display *d)
+{
+    for (int p = 0; p < DISPLAY_PLANES; p++)
+    {
+        if (d->planeMask & (1 << p))
+        {
+            memset(d->planes[p], 0, sizeof(d->planes[p]));
+        }
+    }
+    d->drawFlag = 1;
+}
+
+void setResolution(Display *d, int hires)
+{
+    d->hires = hires != 0;
+    d->width = hires ? DISPLAY_WIDTH : LORES_WIDTH;
+    d->height = hires ? DISPLAY_HEIGHT : LORES_HEIGHT;
+    // switching resolution clears every plane
+    memset(d->planes, 0, sizeof(d->planes));
+    d->drawFlag = 1;
+}
+
+// scroll amounts are in pixels of the current resolution
+
+void scrollDown(Display *d, int n)
+{
+    if (n > d->height)
+    {
+        n = d->height;
+    }
+    for (int p = 0; p < DISPLAY_PLANES; p++)
+    {
+        if (d->planeMask & (1 << p))
+        {
+            memmove(d->planes[p][n], d->planes[p][0], (d->height - n) * sizeof(d->planes[p][0]));
+            memset(d->planes[p][0], 0, n * sizeof(d->planes[p][0]));
+        }
+    }
+    d->drawFlag = 1;
+}
+
+void scrollUp(Display *d, int n)
+{
+    if (n > d->height)
+    {
+        n = d->height;
+    }
+    for (int p = 0; p < DISPLAY_PLANES; p++)
+    {
+        if (d->planeMask & (1 << p))
+        {
+            memmove(d->planes[p][0], d->planes[p][n], (d->height - n) * sizeof(d->planes[p][0]));
+            memset(d->planes[p][d->height - n], 0, n * sizeof(d->planes[p][0]));
+        }
+    }
+    d->drawFlag = 1;
+}
+
+void scrollRight(Display *d, int n)
+{
+    for (int p = 0; p < DISPLAY_PLANES; p++)
+    {
+        if (!(d->planeMask & (1 << p)))
+        {
+            continue;
+        }
+        for (int y = 0; y < d->height; y++)
+        {
+            uint64_t *row = d->planes[p][y];
+            if (d->hires)
+            {
+                row[1] = (row[1] >> n) | (row[0] << (64 - n));
+            }
+            row[0] >>= n;
+        }
+    }
+    d->drawFlag = 1;
+}
+
+void scrollLeft(Display *d, int n)
+{
+    for (int p = 0; p < DISPLAY_PLANES; p++)
+    {
+        if (!(d->planeMask & (1 << p)))
+        {
+            continue;
+        }
+        for (int y = 0; y < d->height; y++)
+        {
+            uint64_t *row = d->planes[p][y];
+            row[0] = (row[0] << n) | (row[1] >> (64 - n));
+            row[1] <<= n;
+        }
+    }
+    d->drawFlag = 1;
+}
+
+// spread[b] holds the 8 bits of b as 8 bytes of 0 or 1, leftmost pixel first
+#define SPREAD1(b) {((b) >> 7) & 1, ((b) >> 6) & 1, ((b) >> 5) & 1, ((b) >> 4) & 1, \
+                    ((b) >> 3) & 1, ((b) >> 2) & 1, ((b) >> 1) & 1, (b) & 1}
+#define SPREAD4(b) SPREAD1(b), SPREAD1((b) + 1), SPREAD1((b) + 2), SPREAD1((b) + 3)
+#define SPREAD16(b) SPREAD4(b), SPREAD4((b) + 4), SPREAD4((b) + 8), SPREAD4((b) + 12)
+#define SPREAD64(b) SPREAD16(b), SPREAD16((b) + 16), SPREAD16((b) + 32), SPREAD16((b) + 48)
+
+static const unsigned char spread[256][8] = {SPREAD64(0), SPREAD64(64), SPREAD64(128), SPREAD64(192)};
+
+// Expands the planes into one colour index (0-3) per byte, width * height
+// bytes in row order. Eight pixels are composited per table lookup: the
+// spread byte lanes of plane 1 are shifted onto bit 1 of each lane and or'd
+// with plane 0, so no per-pixel work is done.
+void compositeDisplay(const Display *d, unsigned char *out)
+{
+    int words = d->width / 64;
+    for (int y = 0; y < d->height; y++)
+    {
+        for (int w = 0; w < words; w++)
+        {
+            uint64_t p0 = d->planes[0][y][w];
+            uint64_t p1 = d->planes[1][y][w];
+            for (int shift = 56; shift >= 0; shift -= 8)
+            {
+                uint64_t low, high;
+                memcpy(&low, spread[(p0 >> shift) & 0xFF], 8);
+                memcpy(&high, spread[(p1 >> shift) & 0xFF], 8);
+                // lanes are 0 or 1, so the shift never crosses into the next byte
+                uint64_t lanes = low | high << 1;
+                memcpy(out, &lanes, 8);
+                out += 8;
+            }
+        }
+    }
+}
+
+// Hash of what is on screen: the resolution and the visible part of each
+// plane, so bits a scroll or wrap left off screen do not count.
+uint64_t displayHash(const Display *d)
+{
+    uint64_t h = hashValue(HASH_SEED, d->hires, 1);
+    int words = d->width / 64;
+    for (int p = 0; p < DISPLAY_PLANES; p++)
+    {
+        for (int y = 0; y < d->height; y++)
+        {
+            for (int w = 0; w < words; w++)
+            {
+                h = hashValue(h, d->planes[p][y][w], 8);
+            }
+        }
+    }
+    return h;
+}
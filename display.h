@@ -0,0 +1,92 @@
+#ifndef DISPLAY_H
+#define DISPLAY_H
+
+#include <stdint.h>
+
+#define DISPLAY_WIDTH 128 // SUPER-CHIP hi-res, lo-res uses the top-left 64x32
+#define DISPLAY_HEIGHT 64
+#define LORES_WIDTH 64
+#define LORES_HEIGHT 32
+#define DISPLAY_PLANES 2 // XO-CHIP bitplanes, a pixel's colour is 0-3
+
+// RGB of each colour index: the background and the three XO-CHIP plane
+// colours, used by the window and by recordings
+extern const uint8_t displayPalette[4][3];
+
+// Packed framebuffer: one bit per pixel per plane, each row is 128 bits in
+// two words with x = 0 in the most significant bit of planes[p][y][0].
+// Lo-res only uses the first word, so a sprite row is one shift and xor and
+// scrolls are shifts. CHIP-8 and SUPER-CHIP only ever select plane 0.
+typedef struct
+{
+    int updateCounter;
+    char drawFlag;
+    char hires;     // 1 in the 128x64 SUPER-CHIP mode
+    char planeMask; // planes affected by draw, clear and scroll (XO-CHIP FN01)
+    int width;
+    int height;
+    uint64_t planes[DISPLAY_PLANES][DISPLAY_HEIGHT][2];
+} Display;
+
+void clearDisplay(Display *d);
+void setResolution(Display *d, int hires);
+void scrollDown(Display *d, int n);
+void scrollUp(Display *d, int n);
+void scrollRight(Display *d, int n);
+void scrollLeft(Display *d, int n);
+void compositeDisplay(const Display *d, unsigned char *out);
+uint64_t displayHash(const Display *d);
+
+#define HASH_SEED 0xcbf29ce484222325ULL // FNV-1a 64-bit offset basis
+
+// feeds the low size bytes of value, least significant first, into an
+// FNV-1a hash, so hashes agree between hosts of either byte order
+static inline uint64_t hashValue(uint64_t h, uint64_t value, int size)
+{
+    for (int k = 0; k < size; k++)
+    {
+        h = (h ^ ((value >> (8 * k)) & 0xFF)) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+// colour index 0-3 of a pixel
+static inline int displayPixel(const Display *d, int x, int y)
+{
+    int shift = 63 - (x & 63);
+    return ((d->planes[0][y][x >> 6] >> shift) & 1) | ((d->planes[1][y][x >> 6] >> shift) & 1) << 1;
+}
+
+// xors one sprite row onto row y of a plane at column x, bits is 16 pixels
+// wide with the leftmost pixel in bit 15. Pixels past the right edge are
+// clipped, or wrapped to the left edge when wrap is set.
+// Returns 1 if a lit pixel was turned off.
+static inline int xorSpriteRow(Display *d, int plane, int x, int y, unsigned int bits, int wrap)
+{
+    uint64_t sprite = (uint64_t)bits << 48;
+    uint64_t left, right;
+    if (x < 64)
+    {
+        left = sprite >> x;
+        right = x != 0 ? sprite << (64 - x) : 0;
+    }
+    else
+    {
+        left = wrap && x > 112 ? sprite << (128 - x) : 0;
+        right = sprite >> (x - 64);
+    }
+    if (!d->hires)
+    {
+        // whatever spilled into the second word is off screen
+        left |= wrap ? right : 0;
+        right = 0;
+    }
+
+    uint64_t *row = d->planes[plane][y];
+    int collision = ((row[0] & left) | (row[1] & right)) != 0;
+    row[0] ^= left;
+    row[1] ^= right;
+    return collision;
+}
+
+#endif
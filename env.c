@@ -0,0 +1,262 @@
+#include "env.h"
+#include <stdlib.h>
+#include <string.h>
+
+void initEnvConfig(EnvConfig *config)
+{
+    memset(config, 0, sizeof(EnvConfig));
+    config->profile = PROFILE_SCHIP;
+    config->timing = TIMING_FAST;
+    config->instructionsPerFrame = 12;
+    config->frameSkip = 1;
+    config->seed = 1;
+    config->doneAddr = -1;
+}
+
+static double readScore(const Env *e, const Chip *c)
+{
+    double score = 0;
+    for (int r = 0; r < e->config.rewardCount; r++)
+    {
+        const EnvReward *source = &e->config.rewards[r];
+        uint32_t value = 0;
+        for (int k = 0; k < source->bytes; k++)
+        {
+            unsigned char byte = c->mem[(source->addr + k) & (c->memSize - 1)];
+            value = source->bcd ? value * 10 + byte % 10 : value << 8 | byte;
+        }
+        score += value * (double)source->scale;
+    }
+    return score;
+}
+
+// starts environment n's next episode from the power-on state, with its
+// own CXNN seed
+static void resetOne(Env *e, int n)
+{
+    Chip *c = e->chips[n];
+    copyChip(c, e->initial);
+    uint32_t seed = e->config.seed + n * 0x9E3779B9u + e->episodes[n]++ * 0x85EBCA6Bu;
+    c->rng = seed != 0 ? seed : 1;
+    e->start[n] = c->frame;
+    e->score[n] = readScore(e, c);
+}
+
+static void writeObservation(const Display *d, unsigned char *out)
+{
+    if (d->hires)
+    {
+        compositeDisplay(d, out);
+        return;
+    }
+    unsigned char lores[LORES_WIDTH * LORES_HEIGHT];
+    compositeDisplay(d, lores);
+    for (int y = 0; y < LORES_HEIGHT; y++)
+    {
+        unsigned char *row = out + 2 * y * DISPLAY_WIDTH;
+        for (int x = 0; x < LORES_WIDTH; x++)
+        {
+            row[2 * x] = row[2 * x + 1] = lores[y * LORES_WIDTH + x];
+        }
+        memcpy(row + DISPLAY_WIDTH, row, DISPLAY_WIDTH);
+    }
+}
+
+static void stepOne(Env *e, int n)
+{
+    Chip *c = e->chips[n];
+    const EnvConfig *config = &e->config;
+    for (int f = 0; f < config->frameSkip && !c->exited && !c->fault; f++)
+    {
+        setPad(c, e->actions[n]);
+        runFrame(c, config->instructionsPerFrame);
+    }
+    double score = readScore(e, c);
+    e->rewards[n] = score - e->score[n];
+    e->score[n] = score;
+    int done = c->exited || c->fault ||
+               (config->doneAddr >= 0 && c->mem[config->doneAddr & (c->memSize - 1)] == config->doneValue) ||
+               (config->maxFrames != 0 && c->frame - e->start[n] >= config->maxFrames);
+    e->dones[n] = done;
+    if (done)
+    {
+        resetOne(e, n);
+    }
+}
+
+// claims environments ENV_CHUNK at a time until the call is done
+static void runShare(Env *e)
+{
+    int first;
+    while ((first = atomic_fetch_add(&e->next, ENV_CHUNK)) < e->count)
+    {
+        int last = first + ENV_CHUNK < e->count ? first + ENV_CHUNK : e->count;
+        for (int n = first; n < last; n++)
+        {
+            if (e->actions == NULL)
+            {
+                resetOne(e, n);
+            }
+            else
+            {
+                stepOne(e, n);
+            }
+            writeObservation(e->chips[n]->display, e->obs + (size_t)n * ENV_OBS_SIZE);
+        }
+    }
+}
+
+static void *worker(void *arg)
+{
+    Env *e = arg;
+    uint64_t seen = 0;
+    pthread_mutex_lock(&e->lock);
+    for (;;)
+    {
+        while (e->generation == seen && !e->stopping)
+        {
+            pthread_cond_wait(&e->wake, &e->lock);
+        }
+        if (e->stopping)
+        {
+            break;
+        }
+        seen = e->generation;
+        pthread_mutex_unlock(&e->lock);
+        runShare(e);
+        pthread_mutex_lock(&e->lock);
+        if (--e->busy == 0)
+        {
+            pthread_cond_signal(&e->finished);
+        }
+    }
+    pthread_mutex_unlock(&e->lock);
+    return NULL;
+}
+
+// wakes the pool for one call, takes a share of it and waits for the rest
+static void runCall(Env *e)
+{
+    atomic_store(&e->next, 0);
+    pthread_mutex_lock(&e->lock);
+    e->generation++;
+    e->busy = e->config.threads;
+    pthread_cond_broadcast(&e->wake);
+    pthread_mutex_unlock(&e->lock);
+
+    runShare(e);
+
+    pthread_mutex_lock(&e->lock);
+    while (e->busy > 0)
+    {
+        pthread_cond_wait(&e->finished, &e->lock);
+    }
+    pthread_mutex_unlock(&e->lock);
+}
+
+static void freeEnv(Env *e)
+{
+    for (int n = 0; e->chips != NULL && n < e->count; n++)
+    {
+        destroyChip(e->chips[n]);
+    }
+    destroyChip(e->initial);
+    free(e->chips);
+    free(e->score);
+    free(e->start);
+    free(e->episodes);
+    free(e->pool);
+    free(e);
+}
+
+// Creates count machines running rom under config, and config->threads
+// worker threads. Call resetEnv before the first step.
+// Returns NULL if the config is invalid or the per-machine arrays could
+// not be allocated.
+Env *createEnv(const unsigned char *rom, size_t size, int count, const EnvConfig *config)
+{
+    if (count < 1 || config->frameSkip < 1 || config->threads < 0 || config->rewardCount < 0 ||
+        config->rewardCount > ENV_REWARDS || config->profile < 0 || config->profile >= PROFILE_COUNT)
+    {
+        return NULL;
+    }
+    for (int r = 0; r < config->rewardCount; r++)
+    {
+        if (config->rewards[r].bytes < 1 || config->rewards[r].bytes > 4)
+        {
+            return NULL;
+        }
+    }
+    Env *e = calloc(1, sizeof(Env));
+    if (e == NULL)
+    {
+        return NULL;
+    }
+    e->config = *config;
+    e->count = count;
+    e->initial = createMachine(config->profile);
+    e->initial->timing = config->timing;
+    loadRomBuffer(rom, size, e->initial);
+    e->chips = calloc(count, sizeof(Chip *));
+    e->score = calloc(count, sizeof(double));
+    e->start = calloc(count, sizeof(uint64_t));
+    e->episodes = calloc(count, sizeof(uint32_t));
+    e->pool = calloc(config->threads + 1, sizeof(pthread_t));
+    if (e->chips == NULL || e->score == NULL || e->start == NULL || e->episodes == NULL || e->pool == NULL)
+    {
+        freeEnv(e);
+        return NULL;
+    }
+    for (int n = 0; n < count; n++)
+    {
+        e->chips[n] = createMachine(config->profile);
+    }
+
+    pthread_mutex_init(&e->lock, NULL);
+    pthread_cond_init(&e->wake, NULL);
+    pthread_cond_init(&e->finished, NULL);
+    for (int k = 0; k < config->threads; k++)
+    {
+        pthread_create(&e->pool[k], NULL, worker, e);
+    }
+    return e;
+}
+
+// starts a new episode on every machine and writes their first observations
+void resetEnv(Env *e, unsigned char *obs)
+{
+    e->actions = NULL;
+    e->obs = obs;
+    runCall(e);
+}
+
+// holds actions[n] (a keypad mask, bit k is key k) down on machine n for
+// config.frameSkip frames and writes what came of it
+void stepEnv(Env *e, const uint16_t *actions, unsigned char *obs, float *rewards, unsigned char *dones)
+{
+    e->actions = actions;
+    e->obs = obs;
+    e->rewards = rewards;
+    e->dones = dones;
+    runCall(e);
+}
+
+void destroyEnv(Env *e)
+{
+    if (e == NULL)
+    {
+        return;
+    }
+    pthread_mutex_lock(&e->lock);
+    e->stopping = 1;
+    pthread_cond_broadcast(&e->wake);
+    pthread_mutex_unlock(&e->lock);
+    for (int k = 0; k < e->config.threads; k++)
+    {
+        pthread_join(e->pool[k], NULL);
+    }
+    pthread_mutex_destroy(&e->lock);
+    pthread_cond_destroy(&e->wake);
+    pthread_cond_destroy(&e->finished);
+    freeEnv(e);
+}
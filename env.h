@@ -0,0 +1,80 @@
+#ifndef ENV_H
+#define ENV_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include "chip.h"
+
+#define ENV_OBS_SIZE (DISPLAY_WIDTH * DISPLAY_HEIGHT) // bytes of one observation
+#define ENV_REWARDS 8 // memory locations a reward can be read from
+#define ENV_CHUNK 8   // environments a thread claims at a time
+
+// A number the ROM keeps in memory. The reward for a step is the change
+// over the step in the sum of every source times its scale.
+typedef struct
+{
+    uint16_t addr;
+    uint8_t bytes; // 1-4, most significant first
+    uint8_t bcd;   // one decimal digit per byte, as FX33 stores them
+    float scale;
+} EnvReward;
+
+typedef struct
+{
+    int profile;              // PROFILE_
+    int timing;               // TIMING_
+    int instructionsPerFrame; // for TIMING_FAST
+    int frameSkip;            // frames each action is held for, rewards summed
+    uint64_t maxFrames;       // frames an episode is cut off at, 0 for no limit
+    uint32_t seed;            // CXNN seeds are derived from it per environment and episode
+    EnvReward rewards[ENV_REWARDS];
+    int rewardCount;
+    int doneAddr; // an episode also ends when this byte equals doneValue, -1 for none
+    uint8_t doneValue;
+    int threads; // workers besides the calling thread
+} EnvConfig;
+
+// A batch of machines running the same ROM in lockstep, for training
+// agents. stepEnv runs every machine one step on a pool of threads and
+// writes results into arrays the caller owns, so a step allocates nothing:
+//
+//   obs      count * ENV_OBS_SIZE bytes, one colour index (0-3) per pixel,
+//            128x64 with lo-res pixels doubled
+//   rewards  count floats
+//   dones    count bytes, 1 where the episode ended in this step
+//
+// A machine whose episode ends is reset at once, so its observation is
+// the first of the next episode, as in auto-resetting vector environments.
+typedef struct
+{
+    EnvConfig config;
+    int count;
+    Chip *initial; // the ROM loaded at power-on, every episode starts as a copy
+    Chip **chips;
+    double *score;       // reward sum at the end of the last step
+    uint64_t *start;     // Chip.frame the episode started at
+    uint32_t *episodes;  // episodes each machine has begun
+    // the call being run, set before the workers are woken
+    const uint16_t *actions; // NULL to reset
+    unsigned char *obs;
+    float *rewards;
+    unsigned char *dones;
+    atomic_int next; // first environment not yet claimed
+    // guarded by lock
+    uint64_t generation; // calls started, workers wait for it to change
+    int busy;            // workers still in the current call
+    int stopping;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t finished;
+    pthread_t *pool;
+} Env;
+
+void initEnvConfig(EnvConfig *config);
+Env *createEnv(const unsigned char *rom, size_t size, int count, const EnvConfig *config);
+void resetEnv(Env *e, unsigned char *obs);
+void stepEnv(Env *e, const uint16_t *actions, unsigned char *obs, float *rewards, unsigned char *dones);
+void destroyEnv(Env *e);
+
+#endif
@@ -0,0 +1,198 @@
+#include "env.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Throughput of the batched training environment (env.h).
+//
+//   envbench [-n ENVS] [-j THREADS] [-s STEPS] [-k FRAMESKIP] [--ipf N]
+//            [--profile NAME] [--max-frames N] [--reward ADDR[:BYTES[:bcd]]]
+//            [--done ADDR=VALUE] rom
+//
+// Steps ENVS machines STEPS times with random keypad actions and reports
+// frames per second over the whole batch, with the episodes that ended and
+// the reward collected. ADDR and VALUE take C notation, e.g. 0x2F0.
+
+#define ENVS 256
+#define STEPS 1000
+#define ROM_SIZE 65536
+
+static int parseReward(EnvConfig *config, const char *s)
+{
+    if (config->rewardCount == ENV_REWARDS)
+    {
+        return -1;
+    }
+    EnvReward *r = &config->rewards[config->rewardCount];
+    char *end;
+    r->addr = strtoul(s, &end, 0);
+    r->bytes = 1;
+    r->scale = 1;
+    if (*end == ':')
+    {
+        r->bytes = strtoul(end + 1, &end, 0);
+    }
+    if (*end == ':' && strcmp(end + 1, "bcd") == 0)
+    {
+        r->bcd = 1;
+        end += 4;
+    }
+    if (end == s || *end != 0)
+    {
+        return -1;
+    }
+    config->rewardCount++;
+    return 0;
+}
+
+static double now()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+    const char *usage = "usage: envbench [-n ENVS] [-j THREADS] [-s STEPS] [-k FRAMESKIP] [--ipf N] "
+                        "[--profile NAME] [--max-frames N] [--reward ADDR[:BYTES[:bcd]]] [--done ADDR=VALUE] rom\n";
+    EnvConfig config;
+    initEnvConfig(&config);
+    int envs = ENVS;
+    long steps = STEPS;
+    const char *path = NULL;
+    int profileGiven = 0;
+    for (int a = 1; a < argc; a++)
+    {
+        int more = a + 1 < argc;
+        if (strcmp(argv[a], "-n") == 0 && more)
+        {
+            envs = atoi(argv[++a]);
+        }
+        else if (strcmp(argv[a], "-j") == 0 && more)
+        {
+            config.threads = atoi(argv[++a]) - 1;
+        }
+        else if (strcmp(argv[a], "-s") == 0 && more)
+        {
+            steps = atol(argv[++a]);
+        }
+        else if (strcmp(argv[a], "-k") == 0 && more)
+        {
+            config.frameSkip = atoi(argv[++a]);
+        }
+        else if (strcmp(argv[a], "--ipf") == 0 && more)
+        {
+            config.instructionsPerFrame = atoi(argv[++a]);
+        }
+        else if (strcmp(argv[a], "--profile") == 0 && more)
+        {
+            if ((config.profile = profileFromName(argv[++a])) < 0)
+            {
+                fprintf(stderr, "Unknown profile %s\n", argv[a]);
+                return 1;
+            }
+            profileGiven = 1;
+        }
+        else if (strcmp(argv[a], "--max-frames") == 0 && more)
+        {
+            config.maxFrames = strtoull(argv[++a], NULL, 10);
+        }
+        else if (strcmp(argv[a], "--reward") == 0 && more)
+        {
+            if (parseReward(&config, argv[++a]) < 0)
+            {
+                fprintf(stderr, "Bad reward %s\n", argv[a]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[a], "--done") == 0 && more)
+        {
+            char *end;
+            config.doneAddr = strtol(argv[++a], &end, 0);
+            if (*end != '=')
+            {
+                fprintf(stderr, "Bad done condition %s\n", argv[a]);
+                return 1;
+            }
+            config.doneValue = strtoul(end + 1, NULL, 0);
+        }
+        else if (argv[a][0] != '-' && path == NULL)
+        {
+            path = argv[a];
+        }
+        else
+        {
+            fprintf(stderr, "%s", usage);
+            return 1;
+        }
+    }
+    if (path == NULL)
+    {
+        fprintf(stderr, "%s", usage);
+        return 1;
+    }
+    if (!profileGiven)
+    {
+        config.profile = profileForRom(path);
+    }
+
+    FILE *fpin = fopen(path, "rb");
+    if (fpin == NULL)
+    {
+        fprintf(stderr, "Error opening %s\n", path);
+        return 127;
+    }
+    unsigned char *rom = malloc(ROM_SIZE);
+    size_t size = fread(rom, 1, ROM_SIZE, fpin);
+    fclose(fpin);
+
+    Env *e = createEnv(rom, size, envs, &config);
+    free(rom);
+    if (e == NULL)
+    {
+        fprintf(stderr, "Could not create %d environments\n", envs);
+        return 1;
+    }
+    unsigned char *obs = malloc((size_t)envs * ENV_OBS_SIZE);
+    float *rewards = malloc(envs * sizeof(float));
+    unsigned char *dones = malloc(envs);
+    uint16_t *actions = malloc(envs * sizeof(uint16_t));
+
+    resetEnv(e, obs);
+    uint32_t rng = 1;
+    uint64_t episodes = 0;
+    double reward = 0;
+    double elapsed = 0;
+    for (long s = 0; s < steps; s++)
+    {
+        for (int n = 0; n < envs; n++)
+        {
+            rng ^= rng << 13;
+            rng ^= rng >> 17;
+            rng ^= rng << 5;
+            actions[n] = 1 << (rng >> 28);
+        }
+        double begin = now();
+        stepEnv(e, actions, obs, rewards, dones);
+        elapsed += now() - begin;
+        for (int n = 0; n < envs; n++)
+        {
+            episodes += dones[n];
+            reward += rewards[n];
+        }
+    }
+
+    double frames = (double)steps * envs * config.frameSkip;
+    printf("%d environments, %d threads, %ld steps of %d frames\n", envs, config.threads + 1, steps, config.frameSkip);
+    printf("%.0f frames/s, %.1f us/step\n", frames / elapsed, elapsed / steps * 1e6);
+    printf("%llu episodes ended, reward %.1f\n", (unsigned long long)episodes, reward);
+
+    destroyEnv(e);
+    free(obs);
+    free(rewards);
+    free(dones);
+    free(actions);
+    return 0;
+}
@@ -0,0 +1,99 @@
+#include "chip.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Fuzzing harness for the interpreter, built with AddressSanitizer and
+// UndefinedBehaviorSanitizer.
+//
+//   make fuzz   libFuzzer (clang):  build/fuzz/fuzzer CORPUS_DIR
+//   make afl    AFL++:              afl-fuzz -i SEEDS -o FINDINGS build/afl/fuzzer @@
+//
+// The AFL build reads one input from each file argument, or from stdin,
+// so "make afl AFL_CC=gcc" gives a sanitized binary to replay crashes
+// where neither fuzzer is installed.
+//
+// An input is a three byte header followed by the ROM:
+//   byte 0    bits 0-1 profile, bit 2 VIP timing, bit 3 run through
+//             debugFrame with a breakpoint at 0x200 and the first page of
+//             the ROM watched
+//   byte 1-2  keypad mask, held down every other frame so FX0A completes
+// and the ROM runs for a bounded number of frames.
+
+#define FUZZ_HEADER 3
+#define FUZZ_FRAMES 100
+#define FUZZ_INSTRUCTIONS_PER_FRAME 100
+#define FUZZ_INPUT_SIZE (3 + 65536)
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    if (size < FUZZ_HEADER)
+    {
+        return 0;
+    }
+    Chip *c = createMachine(data[0] & 3);
+    c->timing = data[0] & 4 ? TIMING_VIP : TIMING_FAST;
+    loadRomBuffer(data + FUZZ_HEADER, size - FUZZ_HEADER, c);
+    unsigned short keys = data[1] | data[2] << 8;
+    int debug = (data[0] & 8) && attachDebug(c) != NULL;
+    if (debug)
+    {
+        debugSet(c->debug->breakpoints, 0x200, 1);
+        for (int addr = 0x200; addr < 0x300; addr++)
+        {
+            debugSet(c->debug->watchpoints, addr, 1);
+        }
+    }
+
+    for (int f = 0; f < FUZZ_FRAMES && !c->exited && !c->fault; f++)
+    {
+        setPad(c, f & 1 ? keys : 0);
+        if (!debug)
+        {
+            runFrame(c, FUZZ_INSTRUCTIONS_PER_FRAME);
+            continue;
+        }
+        while (!debugFrame(c, FUZZ_INSTRUCTIONS_PER_FRAME))
+        {
+            // stopped at the breakpoint or after a watched store; each
+            // call runs at least one instruction, so the frame finishes
+        }
+    }
+    destroyChip(c);
+    return 0;
+}
+
+#ifndef FUZZ_LIBFUZZER
+// AFL and crash replay: one input per file, or stdin
+static int runFile(FILE *fpin, unsigned char *buffer)
+{
+    size_t size = fread(buffer, 1, FUZZ_INPUT_SIZE, fpin);
+    return LLVMFuzzerTestOneInput(buffer, size);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned char *buffer = malloc(FUZZ_INPUT_SIZE);
+    if (buffer == NULL)
+    {
+        return 1;
+    }
+    if (argc < 2)
+    {
+        runFile(stdin, buffer);
+    }
+    for (int a = 1; a < argc; a++)
+    {
+        FILE *fpin = fopen(argv[a], "rb");
+        if (fpin == NULL)
+        {
+            fprintf(stderr, "Error opening %s\n", argv[a]);
+            return 127;
+        }
+        runFile(fpin, buffer);
+        fclose(fpin);
+    }
+    free(buffer);
+    return 0;
+}
+#endif
@@ -0,0 +1,520 @@
+#include "gdbstub.h"
+#include "net.h"
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Registers in the order of the target description: V0-VF, I, PC, SP,
+// each sent as little-endian hex.
+#define GDB_REGISTERS 19
+
+// stop signals as GDB numbers them
+#define GDB_SIGINT 2
+#define GDB_SIGTRAP 5
+#define GDB_SIGSEGV 11
+
+static const int registerSize[GDB_REGISTERS] = {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 1};
+
+#define GDB_REG8(n) "    <reg name=\"v" n "\" bitsize=\"8\" type=\"uint8\"/>\n"
+
+static const char targetXml[] =
+    "<?xml version=\"1.0\"?>\n"
+    "<!DOCTYPE target SYSTEM \"gdb-target.dtd\">\n"
+    "<target version=\"1.0\">\n"
+    "  <feature name=\"org.chip8.core\">\n"
+    GDB_REG8("0") GDB_REG8("1") GDB_REG8("2") GDB_REG8("3")
+    GDB_REG8("4") GDB_REG8("5") GDB_REG8("6") GDB_REG8("7")
+    GDB_REG8("8") GDB_REG8("9") GDB_REG8("a") GDB_REG8("b")
+    GDB_REG8("c") GDB_REG8("d") GDB_REG8("e") GDB_REG8("f")
+    "    <reg name=\"i\" bitsize=\"16\" type=\"data_ptr\"/>\n"
+    "    <reg name=\"pc\" bitsize=\"16\" type=\"code_ptr\"/>\n"
+    "    <reg name=\"sp\" bitsize=\"8\" type=\"uint8\"/>\n"
+    "  </feature>\n"
+    "</target>\n";
+
+static const char hexDigits[] = "0123456789abcdef";
+
+static int hexValue(char ch)
+{
+    if (ch >= '0' && ch <= '9')
+    {
+        return ch - '0';
+    }
+    if (ch >= 'a' && ch <= 'f')
+    {
+        return ch - 'a' + 10;
+    }
+    if (ch >= 'A' && ch <= 'F')
+    {
+        return ch - 'A' + 10;
+    }
+    return -1;
+}
+
+static void writeAll(GdbStub *g, const char *data, size_t length)
+{
+    while (length > 0 && g->fd >= 0)
+    {
+        ssize_t n = write(g->fd, data, length);
+        if (n <= 0)
+        {
+            close(g->fd);
+            g->fd = -1;
+            return;
+        }
+        data += n;
+        length -= n;
+    }
+}
+
+// sends $data#checksum
+static void sendPacket(GdbStub *g, const char *data)
+{
+    static char packet[GDB_PACKET_SIZE + 4];
+    size_t length = strlen(data);
+    unsigned char sum = 0;
+    packet[0] = '$';
+    for (size_t k = 0; k < length; k++)
+    {
+        packet[1 + k] = data[k];
+        sum += (unsigned char)data[k];
+    }
+    packet[1 + length] = '#';
+    packet[2 + length] = hexDigits[sum >> 4];
+    packet[3 + length] = hexDigits[sum & 0xF];
+    writeAll(g, packet, length + 4);
+}
+
+static unsigned int getRegister(const Chip *c, int r)
+{
+    switch (r)
+    {
+    case 16:
+        return c->i;
+    case 17:
+        return c->pc;
+    case 18:
+        return c->sp;
+    default:
+        return c->v[r];
+    }
+}
+
+static void setRegister(Chip *c, int r, unsigned int value)
+{
+    switch (r)
+    {
+    case 16:
+        c->i = value;
+        break;
+    case 17:
+        c->pc = value;
+        break;
+    case 18:
+        c->sp = value;
+        break;
+    default:
+        c->v[r] = value;
+        break;
+    }
+}
+
+// appends a register as little-endian hex
+static char *putRegister(char *out, const Chip *c, int r)
+{
+    unsigned int value = getRegister(c, r);
+    for (int k = 0; k < registerSize[r]; k++, value >>= 8)
+    {
+        *out++ = hexDigits[(value >> 4) & 0xF];
+        *out++ = hexDigits[value & 0xF];
+    }
+    return out;
+}
+
+// reads a little-endian hex register, returns the characters used or -1
+static int takeRegister(const char *in, Chip *c, int r)
+{
+    unsigned int value = 0;
+    for (int k = 0; k < registerSize[r]; k++)
+    {
+        int hi = hexValue(in[2 * k]), lo = hi >= 0 ? hexValue(in[2 * k + 1]) : -1;
+        if (lo < 0)
+        {
+            return -1;
+        }
+        value |= (unsigned int)(hi << 4 | lo) << (8 * k);
+    }
+    setRegister(c, r, value);
+    return 2 * registerSize[r];
+}
+
+static void stopReply(GdbStub *g)
+{
+    char reply[32];
+    Debug *d = g->chip->debug;
+    if (g->signal == GDB_SIGTRAP && d->stopped == DEBUG_WATCHPOINT)
+    {
+        snprintf(reply, sizeof(reply), "T%02xwatch:%x;", g->signal, d->watchAddress);
+    }
+    else
+    {
+        snprintf(reply, sizeof(reply), "S%02x", g->signal);
+    }
+    sendPacket(g, reply);
+}
+
+// drops the connection and every breakpoint, the chip runs on without it
+// until a debugger attaches again
+static void detach(GdbStub *g)
+{
+    Debug *d = g->chip->debug;
+    memset(d->breakpoints, 0, sizeof(d->breakpoints));
+    memset(d->watchpoints, 0, sizeof(d->watchpoints));
+    d->steps = -1;
+    if (g->fd >= 0)
+    {
+        close(g->fd);
+        g->fd = -1;
+    }
+    g->running = 0;
+}
+
+static void handlePacket(GdbStub *g, char *p)
+{
+    static char reply[GDB_PACKET_SIZE];
+    Chip *c = g->chip;
+    Debug *d = c->debug;
+    unsigned long addr, length;
+    int type;
+    char *end;
+
+    reply[0] = 0;
+    switch (p[0])
+    {
+    case '?':
+        stopReply(g);
+        return;
+    case 'g':
+    {
+        char *out = reply;
+        for (int r = 0; r < GDB_REGISTERS; r++)
+        {
+            out = putRegister(out, c, r);
+        }
+        *out = 0;
+        break;
+    }
+    case 'G':
+    {
+        const char *in = p + 1;
+        for (int r = 0; r < GDB_REGISTERS; r++)
+        {
+            int used = takeRegister(in, c, r);
+            if (used < 0)
+            {
+                break;
+            }
+            in += used;
+        }
+        strcpy(reply, "OK");
+        break;
+    }
+    case 'p':
+        addr = strtoul(p + 1, NULL, 16);
+        if (addr < GDB_REGISTERS)
+        {
+            *putRegister(reply, c, addr) = 0;
+        }
+        else
+        {
+            strcpy(reply, "E01");
+        }
+        break;
+    case 'P':
+        addr = strtoul(p + 1, &end, 16);
+        strcpy(reply, addr < GDB_REGISTERS && *end == '=' && takeRegister(end + 1, c, addr) > 0 ? "OK" : "E01");
+        break;
+    case 'm':
+        addr = strtoul(p + 1, &end, 16);
+        length = *end == ',' ? strtoul(end + 1, NULL, 16) : 0;
+        if (addr >= c->memSize)
+        {
+            strcpy(reply, "E01");
+            break;
+        }
+        for (unsigned long k = 0; k < length && addr + k < c->memSize && 2 * k + 2 < sizeof(reply); k++)
+        {
+            reply[2 * k] = hexDigits[c->mem[addr + k] >> 4];
+            reply[2 * k + 1] = hexDigits[c->mem[addr + k] & 0xF];
+            reply[2 * k + 2] = 0;
+        }
+        break;
+    case 'M':
+        addr = strtoul(p + 1, &end, 16);
+        length = *end == ',' ? strtoul(end + 1, &end, 16) : 0;
+        if (*end != ':' || addr + length > c->memSize)
+        {
+            strcpy(reply, "E01");
+            break;
+        }
+        for (unsigned long k = 0; k < length; k++)
+        {
+            int hi = hexValue(end[1 + 2 * k]), lo = hi >= 0 ? hexValue(end[2 + 2 * k]) : -1;
+            if (lo < 0)
+            {
+                break;
+            }
+            c->mem[addr + k] = hi << 4 | lo;
+        }
+        strcpy(reply, "OK");
+        break;
+    case 'c':
+    case 's':
+        if (p[1] != 0)
+        {
+            c->pc = strtoul(p + 1, NULL, 16);
+        }
+        d->steps = p[0] == 's' ? 1 : -1;
+        g->running = 1;
+        // the stop reply is sent when the CPU stops
+        return;
+    case 'Z':
+    case 'z':
+        // Z0/Z1 breakpoints, Z2 write watchpoints, in the debug bitmaps
+        type = p[1] - '0';
+        addr = strtoul(p + 3, &end, 16);
+        length = *end == ',' ? strtoul(end + 1, NULL, 16) : 1;
+        if (type == 0 || type == 1)
+        {
+            debugSet(d->breakpoints, addr, p[0] == 'Z');
+            strcpy(reply, "OK");
+        }
+        else if (type == 2)
+        {
+            for (unsigned long k = 0; k < length; k++)
+            {
+                debugSet(d->watchpoints, addr + k, p[0] == 'Z');
+            }
+            strcpy(reply, "OK");
+        }
+        break;
+    case 'H':
+        strcpy(reply, "OK");
+        break;
+    case 'D':
+        sendPacket(g, "OK");
+        detach(g);
+        return;
+    case 'k':
+        c->exited = 1;
+        detach(g);
+        return;
+    case 'q':
+        if (strncmp(p, "qSupported", 10) == 0)
+        {
+            snprintf(reply, sizeof(reply), "PacketSize=%x;qXfer:features:read+", GDB_PACKET_SIZE);
+        }
+        else if (strncmp(p, "qXfer:features:read:target.xml:", 31) == 0)
+        {
+            unsigned long offset = strtoul(p + 31, &end, 16);
+            length = *end == ',' ? strtoul(end + 1, NULL, 16) : 0;
+            unsigned long total = sizeof(targetXml) - 1;
+            offset = offset < total ? offset : total;
+            length = length < total - offset ? length : total - offset;
+            length = length < sizeof(reply) - 2 ? length : sizeof(reply) - 2;
+            reply[0] = offset + length < total ? 'm' : 'l';
+            memcpy(reply + 1, targetXml + offset, length);
+            reply[1 + length] = 0;
+        }
+        else if (strcmp(p, "qAttached") == 0)
+        {
+            strcpy(reply, "1");
+        }
+        else if (strcmp(p, "qfThreadInfo") == 0)
+        {
+            strcpy(reply, "m1");
+        }
+        else if (strcmp(p, "qsThreadInfo") == 0)
+        {
+            strcpy(reply, "l");
+        }
+        else if (strcmp(p, "qC") == 0)
+        {
+            strcpy(reply, "QC1");
+        }
+        break;
+    }
+    // anything else is unsupported, which is an empty reply
+    sendPacket(g, reply);
+}
+
+// reads what the debugger sent, waiting up to waitMs (-1 for ever) for it,
+// and handles every complete packet
+static void receive(GdbStub *g, int waitMs)
+{
+    struct pollfd pfd = {g->fd, POLLIN, 0};
+    if (poll(&pfd, 1, waitMs) <= 0)
+    {
+        return;
+    }
+    ssize_t n = read(g->fd, g->in + g->inLength, sizeof(g->in) - 1 - g->inLength);
+    if (n <= 0)
+    {
+        // the debugger went away
+        detach(g);
+        return;
+    }
+    g->inLength += n;
+
+    int start = 0;
+    while (start < g->inLength && g->fd >= 0)
+    {
+        char *p = g->in + start;
+        if (*p == 0x03)
+        {
+            // Ctrl-C from the debugger
+            if (g->running)
+            {
+                g->running = 0;
+                g->signal = GDB_SIGINT;
+                g->chip->debug->steps = -1;
+                stopReply(g);
+            }
+            start++;
+            continue;
+        }
+        if (*p != '$')
+        {
+            // acknowledgements and noise between packets
+            start++;
+            continue;
+        }
+        char *hash = memchr(p, '#', g->inLength - start);
+        if (hash == NULL || hash + 2 >= g->in + g->inLength)
+        {
+            break;
+        }
+        unsigned char sum = 0;
+        for (char *q = p + 1; q < hash; q++)
+        {
+            sum += (unsigned char)*q;
+        }
+        start = hash + 3 - g->in;
+        int hi = hexValue(hash[1]), lo = hexValue(hash[2]);
+        if (hi < 0 || lo < 0 || (hi << 4 | lo) != sum)
+        {
+            writeAll(g, "-", 1);
+            continue;
+        }
+        writeAll(g, "+", 1);
+        *hash = 0;
+        handlePacket(g, p + 1);
+    }
+    memmove(g->in, g->in + start, g->inLength - start);
+    g->inLength -= start;
+    if (g->inLength == sizeof(g->in) - 1)
+    {
+        // a packet longer than we said we take
+        g->inLength = 0;
+    }
+}
+
+// listens for GDB on port without waiting for it; the chip runs until a
+// debugger connects, which stops it at the next frame boundary as
+// attaching to a running process under gdbserver does
+GdbStub *createGdbStub(Chip *c, int port)
+{
+    GdbStub *g = calloc(1, sizeof(GdbStub));
+    if (g == NULL || attachDebug(c) == NULL)
+    {
+        free(g);
+        return NULL;
+    }
+    g->chip = c;
+    g->fd = -1;
+    g->listener = listenLoopback(port, 1);
+    if (g->listener < 0)
+    {
+        free(g);
+        return NULL;
+    }
+    return g;
+}
+
+// takes a debugger waiting on the listener, if there is one
+static void acceptDebugger(GdbStub *g)
+{
+    g->fd = accept(g->listener, NULL, NULL);
+    if (g->fd >= 0)
+    {
+        g->running = 0;
+        g->signal = g->chip->fault ? GDB_SIGSEGV : GDB_SIGTRAP;
+        g->inLength = 0;
+    }
+}
+
+// Serves the debugger and, unless it has the CPU stopped, runs one frame
+// through debugFrame in place of runFrame. A stopped CPU waits up to
+// waitMs for a command. Returns 1 when a frame finished, 0 otherwise.
+// While no debugger is connected frames run normally.
+int gdbFrame(GdbStub *g, int instructions, int waitMs)
+{
+    Chip *c = g->chip;
+    if (g->fd < 0)
+    {
+        acceptDebugger(g);
+    }
+    if (g->fd < 0)
+    {
+        // finish a frame a stop left part way first
+        if (c->debug->midFrame)
+        {
+            return debugFrame(c, instructions);
+        }
+        runFrame(c, instructions);
+        return 1;
+    }
+
+    receive(g, g->running ? 0 : waitMs);
+    if (!g->running)
+    {
+        return 0;
+    }
+    int finished = debugFrame(c, instructions);
+    if (c->debug->stopped != DEBUG_RUNNING)
+    {
+        g->running = 0;
+        g->signal = GDB_SIGTRAP;
+        stopReply(g);
+    }
+    else if (c->fault)
+    {
+        // the CPU sits on the faulting instruction for gdb to look at
+        g->running = 0;
+        g->signal = GDB_SIGSEGV;
+        stopReply(g);
+    }
+    else if (c->exited)
+    {
+        sendPacket(g, "W00");
+        detach(g);
+    }
+    return finished;
+}
+
+void destroyGdbStub(GdbStub *g)
+{
+    if (g == NULL)
+    {
+        return;
+    }
+    if (g->fd >= 0)
+    {
+        close(g->fd);
+    }
+    close(g->listener);
+    free(g);
+}
@@ -0,0 +1,25 @@
+#ifndef GDBSTUB_H
+#define GDBSTUB_H
+
+#include "chip.h"
+
+#define GDB_PACKET_SIZE 4096
+
+// GDB remote serial protocol server for one chip, driven by the scheduler
+// through gdbFrame. Breakpoints and watchpoints go into Chip.debug.
+typedef struct
+{
+    Chip *chip;
+    int listener; // non-blocking, polled for a debugger while none is connected
+    int fd;       // the connected debugger, -1 while there is none
+    int running; // continue or step requested, frames run
+    int signal;  // reported for the last stop: SIGTRAP, or SIGINT for Ctrl-C
+    char in[GDB_PACKET_SIZE];
+    int inLength;
+} GdbStub;
+
+GdbStub *createGdbStub(Chip *c, int port);
+int gdbFrame(GdbStub *g, int instructions, int waitMs);
+void destroyGdbStub(GdbStub *g);
+
+#endif
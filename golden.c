@@ -0,0 +1,448 @@
+#include "chip.h"
+#include "movie.h"
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Golden image regression runner.
+//
+//   golden [-j THREADS] [--update] [--state] manifest
+//
+// Runs every ROM listed in the manifest headlessly and compares a 64-bit
+// hash of the final screen, and optionally of the whole machine, with the
+// value recorded there. One test per line, paths relative to the manifest:
+//
+//   # comment
+//   roms/pong.ch8 frames=600 input=120:0002,180:0000 fb=0123456789abcdef
+//   roms/car.xo8 movie=car.c8mv fb=... state=...
+//
+// Line options:
+//   frames=N         frames to run, default 600
+//   profile=NAME     quirk profile, default guessed from the extension
+//   timing=vip       VIP cycle timing
+//   ipf=N            instructions per frame, default 12
+//   seed=N           CXNN random seed
+//   movie=PATH       keypad input recorded by main --record, with its
+//                    profile, timing, speed and seed
+//   input=F:MASK,..  keypad input by hand: at frame F the pad becomes MASK
+//                    (hex, bit n is key n)
+//   fb=HASH          expected displayHash after the last frame
+//   state=HASH       expected chipHash after the last frame
+//
+// --update runs the tests and rewrites the manifest with the hashes they
+// produced instead of comparing, keeping comments and the order of lines;
+// state= is only written for lines that already have one, or for all of
+// them with --state. Exits 1 if a test fails.
+
+#define FRAMES 600
+#define INSTRUCTIONS_PER_FRAME 12
+#define LINE_SIZE 1024
+#define PATH_SIZE 512
+
+typedef struct
+{
+    char *line;   // the manifest line as read, without the newline
+    int isTest;   // not a comment or blank
+    int lineNo;
+    char rom[PATH_SIZE];
+    char movie[PATH_SIZE];
+    int profile;
+    int timing;
+    int instructionsPerFrame;
+    long frames;
+    uint32_t seed;
+    int seedGiven;
+    MovieEvent *input;
+    uint32_t inputCount;
+    int hasFb, hasState;
+    uint64_t fb, state;
+    // filled in by the run
+    uint64_t gotFb, gotState;
+    char error[PATH_SIZE + 32];
+} Test;
+
+typedef struct
+{
+    Test *tests;
+    int count;
+    atomic_int next;
+} Queue;
+
+// path of a file named in the manifest, relative to its directory
+static void resolvePath(char *out, const char *manifest, const char *path)
+{
+    const char *slash = strrchr(manifest, '/');
+    if (path[0] == '/' || slash == NULL)
+    {
+        snprintf(out, PATH_SIZE, "%s", path);
+    }
+    else
+    {
+        snprintf(out, PATH_SIZE, "%.*s/%s", (int)(slash - manifest), manifest, path);
+    }
+}
+
+// reads input=F:MASK,F:MASK,... into movie events
+static int parseInput(Test *t, const char *s)
+{
+    while (*s != 0)
+    {
+        char *end;
+        unsigned long long frame = strtoull(s, &end, 10);
+        if (end == s || *end != ':')
+        {
+            return -1;
+        }
+        s = end + 1;
+        unsigned long mask = strtoul(s, &end, 16);
+        if (end == s || mask > 0xFFFF || (*end != ',' && *end != 0))
+        {
+            return -1;
+        }
+        s = *end == ',' ? end + 1 : end;
+        t->input = realloc(t->input, (t->inputCount + 1) * sizeof(MovieEvent));
+        t->input[t->inputCount].frame = frame;
+        t->input[t->inputCount].pad = mask;
+        t->inputCount++;
+    }
+    return 0;
+}
+
+static int parseTest(Test *t, const char *manifest)
+{
+    char copy[LINE_SIZE];
+    snprintf(copy, sizeof(copy), "%s", t->line);
+    char *save;
+    char *word = strtok_r(copy, " \t", &save);
+    resolvePath(t->rom, manifest, word);
+    t->profile = -1;
+    t->timing = TIMING_FAST;
+    t->instructionsPerFrame = INSTRUCTIONS_PER_FRAME;
+    t->frames = FRAMES;
+
+    while ((word = strtok_r(NULL, " \t", &save)) != NULL)
+    {
+        char *value = strchr(word, '=');
+        if (value == NULL)
+        {
+            return -1;
+        }
+        *value++ = 0;
+        if (strcmp(word, "frames") == 0)
+        {
+            t->frames = atol(value);
+        }
+        else if (strcmp(word, "profile") == 0)
+        {
+            if ((t->profile = profileFromName(value)) < 0)
+            {
+                return -1;
+            }
+        }
+        else if (strcmp(word, "timing") == 0)
+        {
+            t->timing = strcmp(value, "vip") == 0 ? TIMING_VIP : TIMING_FAST;
+        }
+        else if (strcmp(word, "ipf") == 0)
+        {
+            t->instructionsPerFrame = atoi(value);
+        }
+        else if (strcmp(word, "seed") == 0)
+        {
+            t->seed = strtoul(value, NULL, 0);
+            t->seedGiven = 1;
+        }
+        else if (strcmp(word, "movie") == 0)
+        {
+            resolvePath(t->movie, manifest, value);
+        }
+        else if (strcmp(word, "input") == 0)
+        {
+            if (parseInput(t, value) < 0)
+            {
+                return -1;
+            }
+        }
+        else if (strcmp(word, "fb") == 0 || strcmp(word, "state") == 0)
+        {
+            uint64_t hash = strtoull(value, NULL, 16);
+            if (word[0] == 'f')
+            {
+                t->fb = hash;
+                t->hasFb = 1;
+            }
+            else
+            {
+                t->state = hash;
+                t->hasState = 1;
+            }
+        }
+        else
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void runTest(Test *t)
+{
+    Movie scripted = {0};
+    Movie *movie = NULL;
+    if (t->movie[0] != 0)
+    {
+        FILE *fpmovie = fopen(t->movie, "rb");
+        movie = fpmovie != NULL ? loadMovie(fpmovie) : NULL;
+        if (fpmovie != NULL)
+        {
+            fclose(fpmovie);
+        }
+        if (movie == NULL)
+        {
+            snprintf(t->error, sizeof(t->error), "cannot read movie %s", t->movie);
+            return;
+        }
+        t->profile = movie->profile;
+        t->timing = movie->timing;
+        t->instructionsPerFrame = movie->instructionsPerFrame;
+    }
+    else if (t->inputCount > 0)
+    {
+        scripted.events = t->input;
+        scripted.count = t->inputCount;
+        movie = &scripted;
+    }
+
+    FILE *fpin = fopen(t->rom, "rb");
+    if (fpin == NULL)
+    {
+        snprintf(t->error, sizeof(t->error), "cannot open ROM %s", t->rom);
+        if (movie != &scripted)
+        {
+            closeMovie(movie);
+        }
+        return;
+    }
+    Chip *c = createMachine(t->profile >= 0 ? t->profile : profileForRom(t->rom));
+    c->timing = t->timing;
+    loadRom(fpin, c);
+    if (movie != NULL && movie != &scripted)
+    {
+        c->rng = movie->seed;
+    }
+    else if (t->seedGiven && t->seed != 0)
+    {
+        c->rng = t->seed;
+    }
+
+    while (c->frame < (uint64_t)t->frames && !c->exited && !c->fault)
+    {
+        if (movie != NULL)
+        {
+            playMovie(movie, c);
+        }
+        runFrame(c, t->instructionsPerFrame);
+    }
+    t->gotFb = displayHash(c->display);
+    t->gotState = chipHash(c);
+    destroyChip(c);
+    if (movie != &scripted)
+    {
+        closeMovie(movie);
+    }
+}
+
+static void *worker(void *arg)
+{
+    Queue *q = arg;
+    int k;
+    while ((k = atomic_fetch_add(&q->next, 1)) < q->count)
+    {
+        if (q->tests[k].isTest && q->tests[k].error[0] == 0)
+        {
+            runTest(&q->tests[k]);
+        }
+    }
+    return NULL;
+}
+
+// the manifest with every test's hashes replaced by the ones it produced
+static int writeManifest(const char *path, Test *tests, int count, int withState)
+{
+    char temp[PATH_SIZE + 8];
+    snprintf(temp, sizeof(temp), "%s.new", path);
+    FILE *fpout = fopen(temp, "w");
+    if (fpout == NULL)
+    {
+        return -1;
+    }
+    for (int k = 0; k < count; k++)
+    {
+        Test *t = &tests[k];
+        if (!t->isTest || t->error[0] != 0)
+        {
+            fprintf(fpout, "%s\n", t->line);
+            continue;
+        }
+        char copy[LINE_SIZE];
+        snprintf(copy, sizeof(copy), "%s", t->line);
+        char *save;
+        const char *sep = "";
+        for (char *word = strtok_r(copy, " \t", &save); word != NULL; word = strtok_r(NULL, " \t", &save))
+        {
+            if (strncmp(word, "fb=", 3) != 0 && strncmp(word, "state=", 6) != 0)
+            {
+                fprintf(fpout, "%s%s", sep, word);
+                sep = " ";
+            }
+        }
+        fprintf(fpout, " fb=%016" PRIx64, t->gotFb);
+        if (t->hasState || withState)
+        {
+            fprintf(fpout, " state=%016" PRIx64, t->gotState);
+        }
+        fputc('\n', fpout);
+    }
+    if (fclose(fpout) != 0 || rename(temp, path) != 0)
+    {
+        remove(temp);
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int threads = 1;
+    int update = 0, withState = 0;
+    const char *manifest = NULL;
+
+    for (int a = 1; a < argc; a++)
+    {
+        if (strcmp(argv[a], "-j") == 0 && a + 1 < argc)
+        {
+            threads = atoi(argv[++a]);
+        }
+        else if (strcmp(argv[a], "--update") == 0)
+        {
+            update = 1;
+        }
+        else if (strcmp(argv[a], "--state") == 0)
+        {
+            withState = 1;
+        }
+        else if (argv[a][0] == '-' || manifest != NULL)
+        {
+            manifest = NULL;
+            break;
+        }
+        else
+        {
+            manifest = argv[a];
+        }
+    }
+    if (manifest == NULL || threads < 1)
+    {
+        fprintf(stderr, "usage: golden [-j THREADS] [--update] [--state] manifest\n");
+        return 2;
+    }
+
+    FILE *fpin = fopen(manifest, "r");
+    if (fpin == NULL)
+    {
+        fprintf(stderr, "Error opening manifest %s\n", manifest);
+        return 127;
+    }
+    Test *tests = NULL;
+    int count = 0;
+    char line[LINE_SIZE];
+    while (fgets(line, sizeof(line), fpin) != NULL)
+    {
+        line[strcspn(line, "\r\n")] = 0;
+        tests = realloc(tests, (count + 1) * sizeof(Test));
+        Test *t = &tests[count++];
+        memset(t, 0, sizeof(Test));
+        t->line = strdup(line);
+        t->lineNo = count;
+        const char *s = line + strspn(line, " \t");
+        t->isTest = *s != 0 && *s != '#';
+        if (t->isTest && parseTest(t, manifest) < 0)
+        {
+            snprintf(t->error, sizeof(t->error), "bad test line");
+        }
+    }
+    fclose(fpin);
+
+    // tests are independent machines, so they share nothing but the queue
+    Queue q = {tests, count};
+    atomic_init(&q.next, 0);
+    pthread_t *pool = malloc(threads * sizeof(pthread_t));
+    for (int k = 0; k < threads; k++)
+    {
+        pthread_create(&pool[k], NULL, worker, &q);
+    }
+    for (int k = 0; k < threads; k++)
+    {
+        pthread_join(pool[k], NULL);
+    }
+    free(pool);
+
+    int run = 0, failed = 0;
+    for (int k = 0; k < count; k++)
+    {
+        Test *t = &tests[k];
+        if (!t->isTest)
+        {
+            continue;
+        }
+        run++;
+        if (t->error[0] != 0)
+        {
+            printf("%s:%d: ERROR %s\n", manifest, t->lineNo, t->error);
+            failed++;
+        }
+        else if (update)
+        {
+            continue;
+        }
+        else if (!t->hasFb)
+        {
+            printf("%s:%d: FAIL %s has no fb= golden, run --update\n", manifest, t->lineNo, t->rom);
+            failed++;
+        }
+        else if (t->gotFb != t->fb || (t->hasState && t->gotState != t->state))
+        {
+            printf("%s:%d: FAIL %s\n", manifest, t->lineNo, t->rom);
+            printf("  fb     expected %016" PRIx64 " got %016" PRIx64 "\n", t->fb, t->gotFb);
+            if (t->hasState)
+            {
+                printf("  state  expected %016" PRIx64 " got %016" PRIx64 "\n", t->state, t->gotState);
+            }
+            failed++;
+        }
+    }
+    if (update)
+    {
+        if (writeManifest(manifest, tests, count, withState) < 0)
+        {
+            fprintf(stderr, "Error writing manifest %s\n", manifest);
+            return 1;
+        }
+        printf("%d goldens written to %s\n", run - failed, manifest);
+    }
+    else
+    {
+        printf("%d tests, %d passed, %d failed\n", run, run - failed, failed);
+    }
+
+    for (int k = 0; k < count; k++)
+    {
+        free(tests[k].line);
+        free(tests[k].input);
+    }
+    free(tests);
+    return failed > 0;
+}
@@ -0,0 +1,247 @@
+#include "chip.h"
+#include "movie.h"
+#include "gdbstub.h"
+#include "capture.h"
+#include "shared.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Runs ROMs without a window, as fast as the host allows.
+//
+//   headless [-f FRAMES] [--ipf N] [--profile NAME] [--timing vip] rom ...
+//   headless --replay MOVIE [-f FRAMES] rom
+//   headless --gdb PORT [-f FRAMES] rom
+//   headless --capture FILE [--capture-scale N] [--palette COLOURS] [-f FRAMES] rom
+//   headless --shm NAME [-f FRAMES] rom
+//
+// Each ROM is run for FRAMES 60 Hz frames from power-on with the given
+// quirk profile, or the one guessed from its extension. Used for batch
+// runs and as the training workload of the profile-guided build.
+//
+// --replay feeds back keypad input recorded by main --record, with the
+// profile, timing, speed and random seed of the recording, so the run
+// is identical to the original. It stops after the last recorded input
+// unless FRAMES is given.
+//
+// Frames spent halted in FX0A are skipped rather than run, up to the
+// next replayed input.
+//
+// --gdb listens for GDB on the loopback PORT without waiting for it. The
+// ROM runs until a debugger attaches, which stops it at the next frame,
+// then under its control until it detaches; another can attach later.
+//
+// --capture records every frame to FILE.y4m, or to a PNG per frame for
+// FILE.png (FILE000000.png, ...), at 128x64 times --capture-scale
+// (default 4). --palette is four RRGGBB colours separated by commas: the
+// background and XO-CHIP planes 1, 2 and 3. Combines with --replay to
+// film a recorded run.
+//
+// --shm publishes every frame to the POSIX shared-memory object NAME and
+// takes key presses from it, see shared.h, so a bot can play the ROM at
+// full speed.
+
+#define FRAMES 6000
+#define INSTRUCTIONS_PER_FRAME 12
+#define CAPTURE_SCALE 4
+
+static const char *usage = "usage: headless [-f FRAMES] [--ipf N] [--profile NAME] [--timing vip] "
+                           "[--replay MOVIE | --gdb PORT] [--capture FILE [--capture-scale N] [--palette COLOURS]] "
+                           "[--shm NAME] rom ...\n";
+
+int main(int argc, char **argv)
+{
+    int frames = FRAMES;
+    int instructionsPerFrame = INSTRUCTIONS_PER_FRAME;
+    int romCount = 0;
+    int profile = -1;
+    int timing = TIMING_FAST;
+    const char *moviePath = NULL;
+    int framesGiven = 0;
+    int gdbPort = 0;
+    const char *capturePath = NULL;
+    int captureScale = CAPTURE_SCALE;
+    const char *capturePalette = NULL;
+    const char *shmName = NULL;
+
+    for (int a = 1; a < argc; a++)
+    {
+        if (strcmp(argv[a], "-f") == 0 && a + 1 < argc)
+        {
+            frames = atoi(argv[++a]);
+            framesGiven = 1;
+        }
+        else if (strcmp(argv[a], "--replay") == 0 && a + 1 < argc)
+        {
+            moviePath = argv[++a];
+        }
+        else if (strcmp(argv[a], "--gdb") == 0 && a + 1 < argc)
+        {
+            gdbPort = atoi(argv[++a]);
+        }
+        else if (strcmp(argv[a], "--capture") == 0 && a + 1 < argc)
+        {
+            capturePath = argv[++a];
+        }
+        else if (strcmp(argv[a], "--capture-scale") == 0 && a + 1 < argc)
+        {
+            captureScale = atoi(argv[++a]);
+        }
+        else if (strcmp(argv[a], "--palette") == 0 && a + 1 < argc)
+        {
+            capturePalette = argv[++a];
+        }
+        else if (strcmp(argv[a], "--shm") == 0 && a + 1 < argc)
+        {
+            shmName = argv[++a];
+        }
+        else if (strcmp(argv[a], "--ipf") == 0 && a + 1 < argc)
+        {
+            instructionsPerFrame = atoi(argv[++a]);
+        }
+        else if (strcmp(argv[a], "--profile") == 0 && a + 1 < argc)
+        {
+            profile = profileFromName(argv[++a]);
+            if (profile < 0)
+            {
+                fprintf(stderr, "Unknown profile %s\n", argv[a]);
+                return 2;
+            }
+        }
+        else if (strcmp(argv[a], "--timing") == 0 && a + 1 < argc)
+        {
+            timing = strcmp(argv[++a], "vip") == 0 ? TIMING_VIP : TIMING_FAST;
+        }
+        else if (argv[a][0] == '-')
+        {
+            fputs(usage, stderr);
+            return 2;
+        }
+        else
+        {
+            argv[++romCount] = argv[a];
+        }
+    }
+    if (romCount == 0 || ((moviePath != NULL || gdbPort > 0 || capturePath != NULL || shmName != NULL) &&
+                          romCount != 1))
+    {
+        fputs(usage, stderr);
+        return 2;
+    }
+
+    Movie *movie = NULL;
+    if (moviePath != NULL)
+    {
+        FILE *fpmovie = fopen(moviePath, "rb");
+        movie = fpmovie != NULL ? loadMovie(fpmovie) : NULL;
+        if (movie == NULL)
+        {
+            fprintf(stderr, "Error reading movie %s\n", moviePath);
+            return 1;
+        }
+        fclose(fpmovie);
+        profile = movie->profile;
+        timing = movie->timing;
+        instructionsPerFrame = movie->instructionsPerFrame;
+        if (!framesGiven)
+        {
+            frames = movie->count ? movie->events[movie->count - 1].frame + 1 : 0;
+        }
+    }
+
+    for (int r = 1; r <= romCount; r++)
+    {
+        FILE *fpin = fopen(argv[r], "rb");
+        if (fpin == NULL)
+        {
+            fprintf(stderr, "Error opening ROM %s\n", argv[r]);
+            return 127;
+        }
+        Chip *chip = createMachine(profile >= 0 ? profile : profileForRom(argv[r]));
+        chip->timing = timing;
+        loadRom(fpin, chip);
+        if (movie != NULL)
+        {
+            chip->rng = movie->seed;
+        }
+        // a batch run can wait for the writer, so no frame is dropped
+        Capture *capture = NULL;
+        if (capturePath != NULL && (capture = createCapture(capturePath, captureScale, capturePalette, 1)) == NULL)
+        {
+            fprintf(stderr, "Error starting capture to %s (.y4m or .png, palette RRGGBB,RRGGBB,RRGGBB,RRGGBB)\n",
+                    capturePath);
+            return 1;
+        }
+        SharedExport *shared = NULL;
+        if (shmName != NULL && (shared = createSharedExport(shmName)) == NULL)
+        {
+            fprintf(stderr, "Error creating shared memory %s\n", shmName);
+            return 1;
+        }
+        GdbStub *gdb = NULL;
+        if (gdbPort > 0 && (gdb = createGdbStub(chip, gdbPort)) == NULL)
+        {
+            fprintf(stderr, "Error listening for gdb on port %d\n", gdbPort);
+            return 1;
+        }
+        // under gdb a fault stops the CPU for inspection instead
+        while (chip->frame < (uint64_t)frames && !chip->exited && (!chip->fault || gdb != NULL))
+        {
+            if (movie != NULL)
+            {
+                playMovie(movie, chip);
+            }
+            if (shared != NULL)
+            {
+                takeSharedKeys(shared, chip, NULL);
+            }
+            if (gdb != NULL)
+            {
+                // a CPU stopped by gdb blocks here until it is resumed
+                if (gdbFrame(gdb, instructionsPerFrame, -1) && capture != NULL)
+                {
+                    captureFrame(capture, chip->display);
+                }
+                if (shared != NULL)
+                {
+                    // as in main, also while stopped, so readers see what gdb changed
+                    publishShared(shared, chip);
+                }
+                continue;
+            }
+            // a reader may press a key at any time, so never skip ahead of it
+            if (chip->waitKey >= 0 && capture == NULL && shared == NULL)
+            {
+                // halted in FX0A: jump straight to the next input, if any
+                uint64_t wake = movie != NULL && !movieFinished(movie) ? movie->events[movie->next].frame : frames;
+                skipFrames(chip, (wake < (uint64_t)frames ? wake : (uint64_t)frames) - chip->frame);
+                continue;
+            }
+            runFrame(chip, instructionsPerFrame);
+            if (capture != NULL)
+            {
+                captureFrame(capture, chip->display);
+            }
+            if (shared != NULL)
+            {
+                publishShared(shared, chip);
+            }
+        }
+        printf("%s: %llu frames, pc=%03X i=%03X\n", argv[r], (unsigned long long)chip->frame, chip->pc, chip->i);
+        if (chip->fault)
+        {
+            fprintf(stderr, "%s: %s at %03X in frame %llu\n", argv[r], faultName(chip->fault), chip->pc,
+                    (unsigned long long)chip->frame);
+        }
+        if (closeCapture(capture) < 0)
+        {
+            fprintf(stderr, "Error writing capture %s\n", capturePath);
+            return 1;
+        }
+        destroySharedExport(shared);
+        destroyGdbStub(gdb);
+        destroyChip(chip);
+    }
+    closeMovie(movie);
+    return 0;
+}
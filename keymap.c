@@ -0,0 +1,131 @@
+#include "keymap.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+// the usual 1234/QWER/ASDF/ZXCV block, by physical position
+static const struct
+{
+    SDL_Scancode scancode;
+    signed char key;
+} defaults[16] = {
+    {SDL_SCANCODE_1, 0x1}, {SDL_SCANCODE_2, 0x2}, {SDL_SCANCODE_3, 0x3}, {SDL_SCANCODE_4, 0xC},
+    {SDL_SCANCODE_Q, 0x4}, {SDL_SCANCODE_W, 0x5}, {SDL_SCANCODE_E, 0x6}, {SDL_SCANCODE_R, 0xD},
+    {SDL_SCANCODE_A, 0x7}, {SDL_SCANCODE_S, 0x8}, {SDL_SCANCODE_D, 0x9}, {SDL_SCANCODE_F, 0xE},
+    {SDL_SCANCODE_Z, 0xA}, {SDL_SCANCODE_X, 0x0}, {SDL_SCANCODE_C, 0xB}, {SDL_SCANCODE_V, 0xF},
+};
+
+static void clearKeymap(Keymap *k)
+{
+    memset(k->keys, KEYMAP_NONE, sizeof(k->keys));
+    memset(k->buttons, KEYMAP_NONE, sizeof(k->buttons));
+}
+
+void defaultKeymap(Keymap *k)
+{
+    clearKeymap(k);
+    for (int n = 0; n < 16; n++)
+    {
+        k->keys[defaults[n].scancode] = defaults[n].key;
+    }
+    // d-pad for the directions most games use, face buttons for actions
+    k->buttons[SDL_CONTROLLER_BUTTON_DPAD_UP] = 0x5;
+    k->buttons[SDL_CONTROLLER_BUTTON_DPAD_LEFT] = 0x7;
+    k->buttons[SDL_CONTROLLER_BUTTON_DPAD_DOWN] = 0x8;
+    k->buttons[SDL_CONTROLLER_BUTTON_DPAD_RIGHT] = 0x9;
+    k->buttons[SDL_CONTROLLER_BUTTON_A] = 0x6;
+    k->buttons[SDL_CONTROLLER_BUTTON_B] = 0x4;
+}
+
+static char *trim(char *s)
+{
+    while (isspace((unsigned char)*s))
+    {
+        s++;
+    }
+    char *end = s + strlen(s);
+    while (end > s && isspace((unsigned char)end[-1]))
+    {
+        *--end = 0;
+    }
+    return s;
+}
+
+// Reads one layout from a keymap file, replacing the whole map:
+//
+//   # comment
+//   [arcade]
+//   Up = 5            SDL scancode name = CHIP-8 key in hex
+//   Keypad 8 = 5
+//   pad:dpup = 5      game controller button (SDL names) = key
+//
+// Returns 0 on success, -1 if the layout is missing or a line is invalid.
+int loadKeymap(Keymap *k, FILE *fpin, const char *layout)
+{
+    char line[256];
+    int inLayout = 0, found = 0, lineNo = 0;
+
+    clearKeymap(k);
+    while (fgets(line, sizeof(line), fpin) != NULL)
+    {
+        lineNo++;
+        char *s = trim(line);
+        if (*s == 0 || *s == '#')
+        {
+            continue;
+        }
+        if (*s == '[')
+        {
+            char *close = strchr(s, ']');
+            if (close != NULL)
+            {
+                *close = 0;
+            }
+            inLayout = strcmp(trim(s + 1), layout) == 0;
+            found |= inLayout;
+            continue;
+        }
+        if (!inLayout)
+        {
+            continue;
+        }
+
+        char *eq = strrchr(s, '=');
+        char *end;
+        long key = eq != NULL ? strtol(trim(eq + 1), &end, 16) : -1;
+        if (eq == NULL || *end != 0 || key < 0 || key > 0xF)
+        {
+            fprintf(stderr, "keymap line %d: expected NAME = KEY\n", lineNo);
+            return -1;
+        }
+        *eq = 0;
+        char *name = trim(s);
+
+        if (strncmp(name, "pad:", 4) == 0)
+        {
+            SDL_GameControllerButton button = SDL_GameControllerGetButtonFromString(name + 4);
+            if (button == SDL_CONTROLLER_BUTTON_INVALID)
+            {
+                fprintf(stderr, "keymap line %d: unknown button %s\n", lineNo, name + 4);
+                return -1;
+            }
+            k->buttons[button] = key;
+        }
+        else
+        {
+            SDL_Scancode scancode = SDL_GetScancodeFromName(name);
+            if (scancode == SDL_SCANCODE_UNKNOWN)
+            {
+                fprintf(stderr, "keymap line %d: unknown key %s\n", lineNo, name);
+                return -1;
+            }
+            k->keys[scancode] = key;
+        }
+    }
+    if (!found)
+    {
+        fprintf(stderr, "keymap has no layout [%s]\n", layout);
+        return -1;
+    }
+    return 0;
+}
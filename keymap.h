@@ -0,0 +1,19 @@
+#ifndef KEYMAP_H
+#define KEYMAP_H
+
+#include <stdio.h>
+#include <SDL2/SDL.h>
+
+#define KEYMAP_NONE -1
+
+// host input to CHIP-8 key (0-F), KEYMAP_NONE where unmapped
+typedef struct
+{
+    signed char keys[SDL_NUM_SCANCODES];
+    signed char buttons[SDL_CONTROLLER_BUTTON_MAX];
+} Keymap;
+
+void defaultKeymap(Keymap *k);
+int loadKeymap(Keymap *k, FILE *fpin, const char *layout);
+
+#endif
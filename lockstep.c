@@ -0,0 +1,377 @@
+#include "chip.h"
+#include "disasm.h"
+#include "movie.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Runs one ROM through two interpreter backends side by side.
+//
+//   lockstep [-a BACKEND] [-b BACKEND] [-n N] [-f FRAMES] [--ipf N] [--profile NAME] rom
+//   lockstep [-a BACKEND] [-b BACKEND] [-n N] --replay MOVIE [-f FRAMES] rom
+//
+// Backends:
+//   fast   the specialised interpreter runFrame uses, idle-loop skipping on
+//   step   cycle(), one instruction at a time through the dispatch table
+//   debug  the debug instantiation debugFrame uses, with nothing set
+//
+// The two machines get the same keypad input and are compared in full
+// every N instructions (default: once per frame) and at every frame end.
+// On a mismatch both are rewound to the last matching point and single
+// stepped to find the first instruction after which they differ, which is
+// printed with the differing state. Exits 1 on a divergence.
+//
+// Only FAST timing is compared; a VIP timing movie is refused.
+
+#define FRAMES 6000
+#define INSTRUCTIONS_PER_FRAME 12
+#define MEM_DIFFS_SHOWN 8
+
+typedef struct
+{
+    const char *name;
+    int (*run)(Chip *c, int count);
+} Backend;
+
+static int runFast(Chip *c, int count)
+{
+    return runInstructions(c, count, 0);
+}
+
+static int runStep(Chip *c, int count)
+{
+    int n;
+    for (n = 0; n < count && c->waitKey < 0 && !c->exited && !c->fault; n++)
+    {
+        cycle(c);
+    }
+    return n;
+}
+
+static int runDebug(Chip *c, int count)
+{
+    return runInstructions(c, count, 1);
+}
+
+static const Backend backends[] = {
+    {"fast", runFast},
+    {"step", runStep},
+    {"debug", runDebug},
+};
+
+static const Backend *backendFromName(const char *name)
+{
+    for (size_t b = 0; b < sizeof(backends) / sizeof(backends[0]); b++)
+    {
+        if (strcmp(name, backends[b].name) == 0)
+        {
+            return &backends[b];
+        }
+    }
+    return NULL;
+}
+
+// prints every field that differs and returns how many do; with out NULL
+// it only counts
+static int diffChips(FILE *out, const Chip *a, const Chip *b)
+{
+    int diffs = 0;
+#define FIELD(name, fmt, x, y)                                                                                         \
+    if ((x) != (y))                                                                                                    \
+    {                                                                                                                  \
+        if (out != NULL)                                                                                               \
+        {                                                                                                              \
+            fprintf(out, "  %-10s " fmt " | " fmt "\n", name, x, y);                                                   \
+        }                                                                                                              \
+        diffs++;                                                                                                       \
+    }
+    FIELD("pc", "%04X", a->pc, b->pc);
+    FIELD("i", "%04X", a->i, b->i);
+    FIELD("sp", "%X", a->sp, b->sp);
+    FIELD("delay", "%02X", a->delayTimer, b->delayTimer);
+    FIELD("sound", "%02X", a->soundTimer, b->soundTimer);
+    FIELD("pitch", "%02X", a->pitch, b->pitch);
+    FIELD("exited", "%d", a->exited, b->exited);
+    FIELD("fault", "%d", a->fault, b->fault);
+    FIELD("waitKey", "%d", a->waitKey, b->waitKey);
+    FIELD("rng", "%08X", (unsigned int)a->rng, (unsigned int)b->rng);
+    FIELD("frame", "%llu", (unsigned long long)a->frame, (unsigned long long)b->frame);
+    FIELD("hires", "%d", a->display->hires, b->display->hires);
+    FIELD("planeMask", "%d", a->display->planeMask, b->display->planeMask);
+    for (int r = 0; r < 16; r++)
+    {
+        char name[16];
+        snprintf(name, sizeof(name), "v%X", r);
+        FIELD(name, "%02X", a->v[r], b->v[r]);
+        snprintf(name, sizeof(name), "stack[%X]", r);
+        FIELD(name, "%04X", a->stack[r], b->stack[r]);
+        snprintf(name, sizeof(name), "flags[%X]", r);
+        FIELD(name, "%02X", a->flags[r], b->flags[r]);
+        snprintf(name, sizeof(name), "pattern[%X]", r);
+        FIELD(name, "%02X", a->pattern[r], b->pattern[r]);
+        snprintf(name, sizeof(name), "key[%X]", r);
+        FIELD(name, "%d", a->keypad->pad[r], b->keypad->pad[r]);
+    }
+#undef FIELD
+
+    int memDiffs = 0;
+    for (unsigned int addr = 0; addr < a->memSize; addr++)
+    {
+        if (a->mem[addr] != b->mem[addr])
+        {
+            if (out != NULL && memDiffs < MEM_DIFFS_SHOWN)
+            {
+                fprintf(out, "  mem[%04X]  %02X | %02X\n", addr, a->mem[addr], b->mem[addr]);
+            }
+            memDiffs++;
+        }
+    }
+    if (out != NULL && memDiffs > MEM_DIFFS_SHOWN)
+    {
+        fprintf(out, "  ... %d more memory bytes\n", memDiffs - MEM_DIFFS_SHOWN);
+    }
+
+    int rowDiffs = 0;
+    for (int p = 0; p < DISPLAY_PLANES; p++)
+    {
+        for (int y = 0; y < DISPLAY_HEIGHT; y++)
+        {
+            if (memcmp(a->display->planes[p][y], b->display->planes[p][y], sizeof(a->display->planes[p][y])) != 0)
+            {
+                if (out != NULL && rowDiffs == 0)
+                {
+                    fprintf(out, "  display    plane %d first differs on row %d\n", p, y);
+                }
+                rowDiffs++;
+            }
+        }
+    }
+    if (out != NULL && rowDiffs > 1)
+    {
+        fprintf(out, "  ... %d display rows in all\n", rowDiffs);
+    }
+    return diffs + memDiffs + rowDiffs;
+}
+
+// rewinds both machines to the snapshots taken before a mismatching run
+// of count instructions and single steps them to the first difference
+static void pinpoint(Chip *a, Chip *b, const Chip *snapA, const Chip *snapB, const Backend *ba, const Backend *bb,
+                     int count, unsigned long long executed)
+{
+    copyChip(a, snapA);
+    copyChip(b, snapB);
+    for (int k = 0; k < count; k++)
+    {
+        Instruction ins;
+        unsigned short pc = a->pc;
+        disassemble(a->mem, a->memSize, pc, a->profile, &ins);
+        int na = ba->run(a, 1);
+        int nb = bb->run(b, 1);
+        if (na != nb || diffChips(NULL, a, b) > 0)
+        {
+            printf("first divergence at instruction %llu (frame %llu): %04X  %04X  %s\n", executed + k + 1,
+                   (unsigned long long)a->frame, pc, ins.opcode, ins.text);
+            if (na != nb)
+            {
+                printf("  ran        %d | %d\n", na, nb);
+            }
+            diffChips(stdout, a, b);
+            return;
+        }
+    }
+    // single stepping hides the difference, so it comes from running the
+    // instructions together, idle-loop skipping for example
+    printf("divergence within instructions %llu-%llu (frame %llu), only when run %d at a time:\n", executed + 1,
+           executed + count, (unsigned long long)a->frame, count);
+    copyChip(a, snapA);
+    copyChip(b, snapB);
+    ba->run(a, count);
+    bb->run(b, count);
+    diffChips(stdout, a, b);
+}
+
+static const char *usage = "usage: lockstep [-a BACKEND] [-b BACKEND] [-n N] [-f FRAMES] [--ipf N] "
+                           "[--profile NAME] [--replay MOVIE] rom\n"
+                           "backends: fast, step, debug\n";
+
+int main(int argc, char **argv)
+{
+    const Backend *ba = &backends[0], *bb = &backends[1];
+    int frames = FRAMES;
+    int framesGiven = 0;
+    int instructionsPerFrame = INSTRUCTIONS_PER_FRAME;
+    int interval = 0;
+    int profile = -1;
+    const char *moviePath = NULL;
+    const char *romPath = NULL;
+
+    for (int a = 1; a < argc; a++)
+    {
+        if ((strcmp(argv[a], "-a") == 0 || strcmp(argv[a], "-b") == 0) && a + 1 < argc)
+        {
+            const Backend *backend = backendFromName(argv[a + 1]);
+            if (backend == NULL)
+            {
+                fprintf(stderr, "Unknown backend %s\n", argv[a + 1]);
+                return 2;
+            }
+            *(argv[a][1] == 'a' ? &ba : &bb) = backend;
+            a++;
+        }
+        else if (strcmp(argv[a], "-n") == 0 && a + 1 < argc)
+        {
+            interval = atoi(argv[++a]);
+        }
+        else if (strcmp(argv[a], "-f") == 0 && a + 1 < argc)
+        {
+            frames = atoi(argv[++a]);
+            framesGiven = 1;
+        }
+        else if (strcmp(argv[a], "--ipf") == 0 && a + 1 < argc)
+        {
+            instructionsPerFrame = atoi(argv[++a]);
+        }
+        else if (strcmp(argv[a], "--profile") == 0 && a + 1 < argc)
+        {
+            profile = profileFromName(argv[++a]);
+            if (profile < 0)
+            {
+                fprintf(stderr, "Unknown profile %s\n", argv[a]);
+                return 2;
+            }
+        }
+        else if (strcmp(argv[a], "--replay") == 0 && a + 1 < argc)
+        {
+            moviePath = argv[++a];
+        }
+        else if (argv[a][0] == '-' || romPath != NULL)
+        {
+            romPath = NULL;
+            break;
+        }
+        else
+        {
+            romPath = argv[a];
+        }
+    }
+    if (romPath == NULL)
+    {
+        fputs(usage, stderr);
+        return 2;
+    }
+
+    // each machine replays its own copy of the movie
+    Movie *movieA = NULL, *movieB = NULL;
+    if (moviePath != NULL)
+    {
+        FILE *fpmovie = fopen(moviePath, "rb");
+        movieA = fpmovie != NULL ? loadMovie(fpmovie) : NULL;
+        if (movieA != NULL)
+        {
+            rewind(fpmovie);
+            movieB = loadMovie(fpmovie);
+        }
+        if (movieB == NULL)
+        {
+            fprintf(stderr, "Error reading movie %s\n", moviePath);
+            return 1;
+        }
+        fclose(fpmovie);
+        if (movieA->timing != TIMING_FAST)
+        {
+            fprintf(stderr, "lockstep compares FAST timing only\n");
+            return 2;
+        }
+        profile = movieA->profile;
+        instructionsPerFrame = movieA->instructionsPerFrame;
+        if (!framesGiven)
+        {
+            frames = movieA->count ? movieA->events[movieA->count - 1].frame + 1 : 0;
+        }
+    }
+    if (interval <= 0)
+    {
+        interval = instructionsPerFrame;
+    }
+
+    Chip *chips[4];
+    for (int k = 0; k < 4; k++)
+    {
+        FILE *fpin = fopen(romPath, "rb");
+        if (fpin == NULL)
+        {
+            fprintf(stderr, "Error opening ROM %s\n", romPath);
+            return 127;
+        }
+        chips[k] = createMachine(profile >= 0 ? profile : profileForRom(romPath));
+        loadRom(fpin, chips[k]);
+        if (movieA != NULL)
+        {
+            chips[k]->rng = movieA->seed;
+        }
+        if (attachDebug(chips[k]) == NULL)
+        {
+            fprintf(stderr, "Error allocating debugger\n");
+            return 1;
+        }
+    }
+    Chip *a = chips[0], *b = chips[1], *snapA = chips[2], *snapB = chips[3];
+
+    unsigned long long executed = 0;
+    int diverged = 0;
+    while (!diverged && a->frame < (uint64_t)frames && !a->exited && !a->fault)
+    {
+        if (movieA != NULL)
+        {
+            playMovie(movieA, a);
+            playMovie(movieB, b);
+        }
+        // the frame is cut into runs of at most interval instructions, each
+        // checked before the next so the mismatch is found in the run that
+        // caused it
+        for (int done = 0; done < instructionsPerFrame && !diverged;)
+        {
+            int count = instructionsPerFrame - done < interval ? instructionsPerFrame - done : interval;
+            copyChip(snapA, a);
+            copyChip(snapB, b);
+            int na = ba->run(a, count);
+            int nb = bb->run(b, count);
+            if (na != nb || diffChips(NULL, a, b) > 0)
+            {
+                pinpoint(a, b, snapA, snapB, ba, bb, count, executed);
+                diverged = 1;
+            }
+            executed += na;
+            done += count;
+            if (na < count)
+            {
+                // halted in FX0A for the rest of the frame
+                break;
+            }
+        }
+        if (!diverged)
+        {
+            tickTimers(a);
+            tickTimers(b);
+            a->frame++;
+            b->frame++;
+        }
+    }
+
+    if (diverged)
+    {
+        printf("%s: %s and %s diverge\n", romPath, ba->name, bb->name);
+    }
+    else
+    {
+        printf("%s: %s and %s agree for %llu frames, %llu instructions\n", romPath, ba->name, bb->name,
+               (unsigned long long)a->frame, executed);
+    }
+    for (int k = 0; k < 4; k++)
+    {
+        destroyChip(chips[k]);
+    }
+    closeMovie(movieA);
+    closeMovie(movieB);
+    return diverged;
+}
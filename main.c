@@ -1,5 +1,15 @@
 #include "chip.h"
+#include "timeline.h"
+#include "movie.h"
+#include "keymap.h"
+#include "audio.h"
+#include "gdbstub.h"
+#include "capture.h"
+#include "shared.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
 #include <time.h>
 
 #ifdef _WIN32
@@ -12,29 +22,87 @@
 #define WIDTH 660
 #define HEIGHT 340
 #define DELAY 3000
+#define TRACE_SIZE 65536 /* default number of instructions kept by --trace */
+#define FRAME_RATE 60
+#define INSTRUCTIONS_PER_FRAME 12 /* about 700 instructions per second */
+#define TIMELINE_SIZE 65536       /* default number of spans kept by --timeline */
+#define LATE_LATCH_MS 3           /* time left before the next frame when --latch late samples input */
+#define LATENCY_REPORT_FRAMES 60  /* how often --latency updates the window title */
+#define CAPTURE_SCALE 4           /* default --capture-scale */
+
+static volatile sig_atomic_t running = 1;
+
+static void stop(int sig)
+{
+    running = 0;
+}
 
 void draw(SDL_Renderer *ren, Display *dis)
 {
-    SDL_RenderClear(ren);
-    SDL_SetRenderDrawColor(ren, 255, 255, 255, 255);
-    for (int x = 0; x < 64; x++)
+    static unsigned char pixels[DISPLAY_WIDTH * DISPLAY_HEIGHT];
+    static SDL_Rect rects[4][DISPLAY_WIDTH * DISPLAY_HEIGHT];
+    int counts[4] = {0, 0, 0, 0};
+    // 10x10 squares in lo-res, 5x5 in hi-res
+    int size = dis->hires ? 5 : 10;
+
+    compositeDisplay(dis, pixels);
+    for (int y = 0; y < dis->height; y++)
     {
-        for (int y = 0; y < 32; y++)
+        for (int x = 0; x < dis->width; x++)
         {
-            if (dis->pixels[y * 64 + x] == 1)
+            int colour = pixels[y * dis->width + x];
+            if (colour != 0)
             {
-                SDL_Rect rect;
-                rect.h = 10;
-                rect.w = 10;
-                rect.x = 10 * x + 10;
-                rect.y = 10 * y + 10;
-                SDL_RenderFillRect(ren, &rect);
+                SDL_Rect *rect = &rects[colour][counts[colour]++];
+                rect->h = size;
+                rect->w = size;
+                rect->x = size * x + 10;
+                rect->y = size * y + 10;
             }
         }
     }
+
+    const uint8_t *rgb = displayPalette[0];
+    SDL_SetRenderDrawColor(ren, rgb[0], rgb[1], rgb[2], 255);
+    SDL_RenderClear(ren);
+    for (int colour = 1; colour < 4; colour++)
+    {
+        rgb = displayPalette[colour];
+        SDL_SetRenderDrawColor(ren, rgb[0], rgb[1], rgb[2], 255);
+        SDL_RenderFillRects(ren, rects[colour], counts[colour]);
+    }
     dis->drawFlag = 0;
-    SDL_SetRenderDrawColor(ren, 0, 0, 0, 255);
-    SDL_RenderPresent(ren);
+}
+
+// input-to-photon: from an input event's timestamp to the present that
+// first shows a frame emulated with it, in milliseconds
+typedef struct
+{
+    Uint32 pending; // timestamp of the oldest input not yet presented, 0 if none
+    unsigned long count;
+    unsigned long total;
+    Uint32 max;
+} Latency;
+
+static void latencyInput(Latency *l, Uint32 timestamp)
+{
+    if (l->pending == 0)
+    {
+        l->pending = timestamp != 0 ? timestamp : 1;
+    }
+}
+
+static void latencyPresented(Latency *l)
+{
+    if (l->pending == 0)
+    {
+        return;
+    }
+    Uint32 sample = SDL_GetTicks() - l->pending;
+    l->count++;
+    l->total += sample;
+    l->max = sample > l->max ? sample : l->max;
+    l->pending = 0;
 }
 
 int main(int argc, char **argv)
@@ -46,7 +114,7 @@ int main(int argc, char **argv)
      * Initialises the SDL video subsystem (as well as the events subsystem).
      * Returns 0 on success or a negative error code on failure using SDL_GetError().
      */
-    if (SDL_Init(SDL_INIT_VIDEO) != 0)
+    if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_GAMECONTROLLER) != 0)
     {
         fprintf(stderr, "SDL failed to initialise: %s\n", SDL_GetError());
         return 1;
@@ -75,22 +143,130 @@ int main(int argc, char **argv)
     }
 
     // SDL_Delay(DELAY);
-    int running = 1;
     SDL_Event e;
-    Chip *chip = createChip();
-    FILE *fpin;
-    if (argc == 1)
-    {
-
-        fpin = fopen("IBM Logo.ch8", "rb");
-    }
-    else if (argc >= 2)
+    const char *romPath = "IBM Logo.ch8";
+    const char *tracePath = NULL;
+    unsigned long traceSize = TRACE_SIZE;
+    const char *timelinePath = NULL;
+    int instructionsPerFrame = INSTRUCTIONS_PER_FRAME;
+    int profile = -1;
+    int timing = TIMING_FAST;
+    const char *moviePath = NULL;
+    const char *keymapPath = NULL;
+    const char *layout = "default";
+    int latchMs = -1; // late by default
+    int showLatency = 0;
+    int mute = 0;
+    int gdbPort = 0;
+    const char *capturePath = NULL;
+    int captureScale = CAPTURE_SCALE;
+    const char *capturePalette = NULL;
+    const char *shmName = NULL;
+    for (int a = 1; a < argc; a++)
     {
-        // first argument is filename
-
-        fpin = fopen(argv[1], "rb");
+        if (strcmp(argv[a], "--trace") == 0 && a + 1 < argc)
+        {
+            // keep the last instructions in memory, written to the file on exit
+            tracePath = argv[++a];
+        }
+        else if (strcmp(argv[a], "--trace-size") == 0 && a + 1 < argc)
+        {
+            traceSize = strtoul(argv[++a], NULL, 10);
+        }
+        else if (strcmp(argv[a], "--timeline") == 0 && a + 1 < argc)
+        {
+            // record run loop phases, written as Chrome trace-event JSON on exit
+            timelinePath = argv[++a];
+        }
+        else if (strcmp(argv[a], "--ipf") == 0 && a + 1 < argc)
+        {
+            instructionsPerFrame = atoi(argv[++a]);
+        }
+        else if (strcmp(argv[a], "--profile") == 0 && a + 1 < argc)
+        {
+            // vip, chip48, schip (default) or xochip (default for .xo8)
+            profile = profileFromName(argv[++a]);
+            if (profile < 0)
+            {
+                fprintf(stderr, "Unknown profile %s\n", argv[a]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[a], "--timing") == 0 && a + 1 < argc)
+        {
+            // fast (default) or vip for COSMAC VIP cycle costs
+            timing = strcmp(argv[++a], "vip") == 0 ? TIMING_VIP : TIMING_FAST;
+        }
+        else if (strcmp(argv[a], "--record") == 0 && a + 1 < argc)
+        {
+            // keypad changes, replayable with headless --replay
+            moviePath = argv[++a];
+        }
+        else if (strcmp(argv[a], "--keymap") == 0 && a + 1 < argc)
+        {
+            keymapPath = argv[++a];
+        }
+        else if (strcmp(argv[a], "--layout") == 0 && a + 1 < argc)
+        {
+            // section of the keymap file to use
+            layout = argv[++a];
+        }
+        else if (strcmp(argv[a], "--latch") == 0 && a + 1 < argc)
+        {
+            // when input is sampled: early (start of the frame), late (just
+            // before the next frame is due) or milliseconds into the frame
+            a++;
+            latchMs = strcmp(argv[a], "early") == 0 ? 0 : strcmp(argv[a], "late") == 0 ? -1 : atoi(argv[a]);
+        }
+        else if (strcmp(argv[a], "--latency") == 0)
+        {
+            // input-to-photon readout in the title bar, summary on exit
+            showLatency = 1;
+        }
+        else if (strcmp(argv[a], "--gdb") == 0 && a + 1 < argc)
+        {
+            // listen for GDB on this loopback port, it can attach at any time
+            gdbPort = atoi(argv[++a]);
+        }
+        else if (strcmp(argv[a], "--capture") == 0 && a + 1 < argc)
+        {
+            // record the screen to a .y4m video or a .png per frame
+            capturePath = argv[++a];
+        }
+        else if (strcmp(argv[a], "--capture-scale") == 0 && a + 1 < argc)
+        {
+            captureScale = atoi(argv[++a]);
+        }
+        else if (strcmp(argv[a], "--palette") == 0 && a + 1 < argc)
+        {
+            // capture colours: RRGGBB for the background and planes 1-3, comma separated
+            capturePalette = argv[++a];
+        }
+        else if (strcmp(argv[a], "--shm") == 0 && a + 1 < argc)
+        {
+            // publish the screen, registers and keypad to this POSIX
+            // shared-memory object each frame, and take keys from it
+            shmName = argv[++a];
+        }
+        else if (strcmp(argv[a], "--mute") == 0)
+        {
+            mute = 1;
+        }
+        else if (strcmp(argv[a], "--xo") == 0)
+        {
+            profile = PROFILE_XOCHIP;
+        }
+        else
+        {
+            // remaining argument is filename
+            romPath = argv[a];
+        }
     }
 
+    Chip *chip = createMachine(profile >= 0 ? profile : profileForRom(romPath));
+    chip->timing = timing;
+    chip->rng = (uint32_t)time(NULL) | 1;
+    FILE *fpin = fopen(romPath, "rb");
     if (fpin == NULL)
     {
 
@@ -98,12 +274,114 @@ int main(int argc, char **argv)
         return 127;
     }
     loadRom(fpin, chip);
-    struct timespec ts;
+    if (tracePath != NULL)
+    {
+        chip->trace = createTrace(traceSize);
+        if (chip->trace == NULL)
+        {
+            fprintf(stderr, "Error allocating trace\n");
+            return 1;
+        }
+    }
+    Keymap keymap;
+    defaultKeymap(&keymap);
+    if (keymapPath != NULL)
+    {
+        FILE *fpkeys = fopen(keymapPath, "r");
+        if (fpkeys == NULL || loadKeymap(&keymap, fpkeys, layout) != 0)
+        {
+            fprintf(stderr, "Error loading keymap %s\n", keymapPath);
+            return 1;
+        }
+        fclose(fpkeys);
+    }
+    Movie *movie = NULL;
+    if (moviePath != NULL)
+    {
+        FILE *fpmovie = fopen(moviePath, "wb");
+        movie = fpmovie != NULL ? createMovie(fpmovie, chip, instructionsPerFrame) : NULL;
+        if (movie == NULL)
+        {
+            fprintf(stderr, "Error creating movie %s\n", moviePath);
+            return 1;
+        }
+    }
+    GdbStub *gdb = NULL;
+    if (gdbPort > 0 && (gdb = createGdbStub(chip, gdbPort)) == NULL)
+    {
+        fprintf(stderr, "Error listening for gdb on port %d\n", gdbPort);
+        return 1;
+    }
+    Audio *audio = NULL;
+    if (!mute)
+    {
+        audio = createAudio(chip->profile == PROFILE_XOCHIP);
+        if (audio == NULL)
+        {
+            fprintf(stderr, "No audio: %s\n", SDL_GetError());
+        }
+    }
+    // frames are dropped rather than let a slow disk stall the run
+    Capture *capture = NULL;
+    if (capturePath != NULL && (capture = createCapture(capturePath, captureScale, capturePalette, 0)) == NULL)
+    {
+        fprintf(stderr, "Error starting capture to %s\n", capturePath);
+        return 1;
+    }
+    SharedExport *shared = NULL;
+    if (shmName != NULL && (shared = createSharedExport(shmName)) == NULL)
+    {
+        fprintf(stderr, "Error creating shared memory %s\n", shmName);
+        return 1;
+    }
+    Timeline *timeline = NULL;
+    if (timelinePath != NULL)
+    {
+        timeline = createTimeline(TIMELINE_SIZE, 1000000 / FRAME_RATE);
+        if (timeline == NULL)
+        {
+            fprintf(stderr, "Error allocating timeline\n");
+            return 1;
+        }
+    }
+    // let a killed or interrupted run still write its trace
+    signal(SIGINT, stop);
+    signal(SIGTERM, stop);
 
-    clock_t start = clock();
+    // Each frame waits for its latch point, samples input once, then runs,
+    // draws and presents. A late latch leaves just enough of the frame for
+    // that work, so input is as fresh as possible when it reaches the screen.
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+    Uint64 frameTicks = frequency / FRAME_RATE;
+    Uint64 latchTicks = latchMs >= 0 ? frequency * latchMs / 1000 : frameTicks - frequency * LATE_LATCH_MS / 1000;
+    if (latchTicks > frameTicks)
+    {
+        latchTicks = frameTicks;
+    }
+    Uint64 frameDue = SDL_GetPerformanceCounter();
+    Latency latency = {0};
     while (running)
     {
-        char *pad = chip->keypad->pad;
+        int key;
+        TIMELINE_SPAN(timeline, "sleep")
+        {
+            // wait for this frame's latch point, resynchronise if we fell behind
+            Uint64 latch = frameDue + latchTicks;
+            Uint64 now = SDL_GetPerformanceCounter();
+            if (now < latch)
+            {
+                SDL_Delay((latch - now) * 1000 / frequency);
+            }
+            else if (now - latch > frameTicks)
+            {
+                frameDue = now - latchTicks;
+            }
+            frameDue += frameTicks;
+        }
+        // the frame span is the work after the sleep, so an overrun means
+        // the work itself took longer than a frame, not that SDL_Delay was late
+        uint64_t frameStart = timelineBegin(timeline);
+        TIMELINE_SPAN(timeline, "input")
         while (SDL_PollEvent(&e) != 0)
         {
             // User requests quit
@@ -112,155 +390,159 @@ int main(int argc, char **argv)
             case SDL_QUIT:
                 running = 0;
                 break;
-            // case SDL_KEYDOWN:
-            //     break;
             case SDL_KEYDOWN:
-                // Only register key after release
-                switch (e.key.keysym.sym)
+            case SDL_KEYUP:
+                key = keymap.keys[e.key.keysym.scancode];
+                if (key != KEYMAP_NONE && e.key.repeat == 0)
                 {
-                case SDLK_1:
-                    chip->keypad->keyPress = 1;
-                    pad[1] = 1;
-                    break;
-                case SDLK_2:
-                    chip->keypad->keyPress = 1;
-                    pad[2] = 1;
-                    break;
-                case SDLK_3:
-                    chip->keypad->keyPress = 1;
-                    pad[3] = 1;
-                    break;
-                case SDLK_4:
-                    chip->keypad->keyPress = 1;
-                    pad[12] = 1;
-                    break;
-                case SDLK_q:
-                    chip->keypad->keyPress = 1;
-                    pad[4] = 1;
-                    break;
-                case SDLK_w:
-                    chip->keypad->keyPress = 1;
-                    pad[5] = 1;
-                    break;
-                case SDLK_e:
-                    chip->keypad->keyPress = 1;
-                    pad[6] = 1;
-                    break;
-                case SDLK_r:
-                    chip->keypad->keyPress = 1;
-                    pad[13] = 1;
-                    break;
-                case SDLK_a:
-                    chip->keypad->keyPress = 1;
-                    pad[7] = 1;
-                    break;
-                case SDLK_s:
-                    chip->keypad->keyPress = 1;
-                    pad[8] = 1;
-                    break;
-                case SDLK_d:
-                    chip->keypad->keyPress = 1;
-                    pad[9] = 1;
-                    break;
-                case SDLK_f:
-                    chip->keypad->keyPress = 1;
-                    pad[14] = 1;
-                    break;
-                case SDLK_z:
-                    chip->keypad->keyPress = 1;
-                    pad[10] = 1;
-                    break;
-                case SDLK_x:
-                    chip->keypad->keyPress = 1;
-                    pad[0] = 1;
-                    break;
-                case SDLK_c:
-                    chip->keypad->keyPress = 1;
-                    pad[11] = 1;
-                    break;
-                case SDLK_v:
-                    chip->keypad->keyPress = 1;
-                    pad[15] = 1;
-                    break;
+                    setKey(chip, key, e.type == SDL_KEYDOWN);
+                    if (movie != NULL)
+                    {
+                        recordPad(movie, chip);
+                    }
+                    latencyInput(&latency, e.key.timestamp);
                 }
                 break;
-            case SDL_KEYUP:
-                // Only register key after release
-                switch (e.key.keysym.sym)
+            case SDL_CONTROLLERBUTTONDOWN:
+            case SDL_CONTROLLERBUTTONUP:
+                key = keymap.buttons[e.cbutton.button];
+                if (key != KEYMAP_NONE)
                 {
-                case SDLK_1:
-                    pad[1] = 0;
-                    break;
-                case SDLK_2:
-                    pad[2] = 0;
-                    break;
-                case SDLK_3:
-                    pad[3] = 0;
-                    break;
-                case SDLK_4:
-                    pad[12] = 0;
-                    break;
-                case SDLK_q:
-                    pad[4] = 0;
-                    break;
-                case SDLK_w:
-                    pad[5] = 0;
-                    break;
-                case SDLK_e:
-                    pad[6] = 0;
-                    break;
-                case SDLK_r:
-                    pad[13] = 0;
-                    break;
-                case SDLK_a:
-                    pad[7] = 0;
-                    break;
-                case SDLK_s:
-                    pad[8] = 0;
-                    break;
-                case SDLK_d:
-                    pad[9] = 0;
-                    break;
-                case SDLK_f:
-                    pad[14] = 0;
-                    break;
-                case SDLK_z:
-                    pad[10] = 0;
-                    break;
-                case SDLK_x:
-                    pad[0] = 0;
-                    break;
-                case SDLK_c:
-                    pad[11] = 0;
-                    break;
-                case SDLK_v:
-                    pad[15] = 0;
-                    break;
+                    setKey(chip, key, e.type == SDL_CONTROLLERBUTTONDOWN);
+                    if (movie != NULL)
+                    {
+                        recordPad(movie, chip);
+                    }
+                    latencyInput(&latency, e.cbutton.timestamp);
                 }
                 break;
+            case SDL_CONTROLLERDEVICEADDED:
+                SDL_GameControllerOpen(e.cdevice.which);
+                break;
             }
         }
-        if ((double)(clock() - start) / CLOCKS_PER_SEC * 10 * 1000000 >= 1)
+        if (shared != NULL)
+        {
+            takeSharedKeys(shared, chip, movie);
+        }
+        TIMELINE_SPAN(timeline, "emulate")
+        {
+            if (gdb != NULL)
+            {
+                // stays on this frame while gdb has the CPU stopped
+                gdbFrame(gdb, instructionsPerFrame, 0);
+            }
+            else
+            {
+                runFrame(chip, instructionsPerFrame);
+            }
+        }
+        queueAudio(audio, chip);
+        if (shared != NULL)
+        {
+            publishShared(shared, chip);
+        }
+        if (chip->exited)
+        {
+            // the ROM ran 00FD
+            running = 0;
+        }
+        if (chip->fault && gdb == NULL)
         {
-            // processor at 1 MHz
-            // chip->updateCounter = -1;
-            cycle(chip);
-            chip->delayTimer--;
-            chip->soundTimer--;
+            // under gdb the stub stops the CPU on the fault instead
+            fprintf(stderr, "%s at %03X\n", faultName(chip->fault), chip->pc);
+            running = 0;
         }
         if (chip->display->drawFlag != 0)
         {
-            // display instantly
-            draw(renderer, chip->display);
+            TIMELINE_SPAN(timeline, "draw")
+            {
+                draw(renderer, chip->display);
+            }
+            TIMELINE_SPAN(timeline, "present")
+            {
+                SDL_RenderPresent(renderer);
+            }
+            latencyPresented(&latency);
+        }
+        if (capture != NULL)
+        {
+            TIMELINE_SPAN(timeline, "capture")
+            {
+                captureFrame(capture, chip->display);
+            }
         }
         chip->display->updateCounter++;
         chip->updateCounter++;
-        start = clock();
+
+        if (showLatency && latency.count > 0 && chip->frame % LATENCY_REPORT_FRAMES == 0)
+        {
+            char title[96];
+            snprintf(title, sizeof(title), "Chip 8 Emulator - input latency %lu ms avg, %u ms max",
+                     latency.total / latency.count, (unsigned)latency.max);
+            SDL_SetWindowTitle(window, title);
+        }
+        timelineEnd(timeline, "frame", frameStart);
+        if (timeline != NULL)
+        {
+            timeline->frame++;
+        }
+    }
+    if (showLatency)
+    {
+        if (latency.count > 0)
+        {
+            printf("input latency: %lu presents, %.1f ms avg, %u ms max\n", latency.count,
+                   (double)latency.total / latency.count, (unsigned)latency.max);
+        }
+        else
+        {
+            printf("input latency: no input presented\n");
+        }
     }
+    if (chip->trace != NULL)
+    {
+        FILE *fpout = fopen(tracePath, "wb");
+        if (fpout == NULL || writeTrace(chip->trace, fpout) != 0)
+        {
+            fprintf(stderr, "Error writing trace %s\n", tracePath);
+        }
+        if (fpout != NULL)
+        {
+            fclose(fpout);
+        }
+    }
+    if (timeline != NULL)
+    {
+        FILE *fpout = fopen(timelinePath, "w");
+        if (fpout == NULL || writeTimeline(timeline, fpout) != 0)
+        {
+            fprintf(stderr, "Error writing timeline %s\n", timelinePath);
+        }
+        if (fpout != NULL)
+        {
+            fclose(fpout);
+        }
+    }
+    if (capture != NULL)
+    {
+        if (capture->dropped > 0)
+        {
+            fprintf(stderr, "capture: %llu frames dropped\n", (unsigned long long)capture->dropped);
+        }
+        if (closeCapture(capture) < 0)
+        {
+            fprintf(stderr, "Error writing capture %s\n", capturePath);
+        }
+    }
+    destroySharedExport(shared);
+    closeMovie(movie);
+    destroyAudio(audio);
+    destroyGdbStub(gdb);
     /* Frees memory */
     SDL_DestroyWindow(window);
     /* Shuts down all SDL subsystems */
     SDL_Quit();
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,144 @@
+#include "movie.h"
+#include <stdlib.h>
+#include <string.h>
+
+Movie *createMovie(FILE *fpout, const Chip *c, int instructionsPerFrame)
+{
+    Movie *m = calloc(1, sizeof(Movie));
+    if (m == NULL)
+    {
+        return NULL;
+    }
+    m->fp = fpout;
+    m->profile = c->profile;
+    m->timing = c->timing;
+    m->instructionsPerFrame = instructionsPerFrame;
+    m->seed = c->rng;
+
+    unsigned char header[14];
+    memcpy(header, MOVIE_MAGIC, 4);
+    header[4] = MOVIE_VERSION & 0xFF;
+    header[5] = MOVIE_VERSION >> 8;
+    header[6] = m->profile;
+    header[7] = m->timing;
+    header[8] = instructionsPerFrame & 0xFF;
+    header[9] = instructionsPerFrame >> 8;
+    for (int k = 0; k < 4; k++)
+    {
+        header[10 + k] = m->seed >> (8 * k);
+    }
+    fwrite(header, sizeof(header), 1, fpout);
+    return m;
+}
+
+void recordMovie(Movie *m, uint64_t frame, uint16_t pad)
+{
+    unsigned char rec[12];
+    int n = 0;
+    uint64_t delta = frame - m->lastFrame;
+    do
+    {
+        rec[n] = delta & 0x7F;
+        delta >>= 7;
+        rec[n++] |= delta ? 0x80 : 0;
+    } while (delta);
+    rec[n++] = pad & 0xFF;
+    rec[n++] = pad >> 8;
+    fwrite(rec, n, 1, m->fp);
+    m->lastFrame = frame;
+}
+
+// records the pad, if it changed since the last event, for the frame about
+// to run; called after every key edge rather than once per frame, so a tap
+// shorter than a frame is kept as a press and a release for the same frame
+void recordPad(Movie *m, const Chip *c)
+{
+    uint16_t pad = padMask(c);
+    if (pad != m->lastPad)
+    {
+        recordMovie(m, c->frame, pad);
+        m->lastPad = pad;
+    }
+}
+
+Movie *loadMovie(FILE *fpin)
+{
+    unsigned char header[14];
+    // the profile indexes the interpreter tables, so one out of range is
+    // rejected along with a bad magic or version
+    if (fread(header, sizeof(header), 1, fpin) != 1 || memcmp(header, MOVIE_MAGIC, 4) != 0 ||
+        (header[4] | header[5] << 8) != MOVIE_VERSION || header[6] >= PROFILE_COUNT || header[7] > TIMING_VIP)
+    {
+        return NULL;
+    }
+    Movie *m = calloc(1, sizeof(Movie));
+    if (m == NULL)
+    {
+        return NULL;
+    }
+    m->profile = header[6];
+    m->timing = header[7];
+    m->instructionsPerFrame = header[8] | header[9] << 8;
+    m->seed = header[10] | header[11] << 8 | header[12] << 16 | (uint32_t)header[13] << 24;
+
+    uint32_t capacity = 0;
+    uint64_t frame = 0;
+    int ch;
+    while ((ch = fgetc(fpin)) != EOF)
+    {
+        uint64_t delta = 0;
+        int shift = 0;
+        delta |= (uint64_t)(ch & 0x7F);
+        while (ch & 0x80 && (ch = fgetc(fpin)) != EOF)
+        {
+            shift += 7;
+            delta |= (uint64_t)(ch & 0x7F) << shift;
+        }
+        int lo = fgetc(fpin);
+        int hi = fgetc(fpin);
+        if (ch == EOF || lo == EOF || hi == EOF)
+        {
+            // a recording cut short by a crash keeps its complete events
+            break;
+        }
+        if (m->count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 256;
+            m->events = realloc(m->events, capacity * sizeof(MovieEvent));
+        }
+        frame += delta;
+        m->events[m->count].frame = frame;
+        m->events[m->count].pad = lo | hi << 8;
+        m->count++;
+    }
+    return m;
+}
+
+// applies the events due at the start of the chip's current frame
+void playMovie(Movie *m, Chip *c)
+{
+    while (m->next < m->count && m->events[m->next].frame <= c->frame)
+    {
+        setPad(c, m->events[m->next].pad);
+        m->next++;
+    }
+}
+
+int movieFinished(const Movie *m)
+{
+    return m->next >= m->count;
+}
+
+void closeMovie(Movie *m)
+{
+    if (m == NULL)
+    {
+        return;
+    }
+    if (m->fp != NULL)
+    {
+        fclose(m->fp);
+    }
+    free(m->events);
+    free(m);
+}
@@ -0,0 +1,47 @@
+#ifndef MOVIE_H
+#define MOVIE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "chip.h"
+
+#define MOVIE_MAGIC "C8MV"
+#define MOVIE_VERSION 1
+
+// one keypad change: the full pad as a bit mask (bit n = key n), taking
+// effect at the start of a frame. Events for the same frame are applied in
+// order, so a key pressed and released between two frames still completes
+// FX0A on replay.
+typedef struct
+{
+    uint64_t frame;
+    uint16_t pad;
+} MovieEvent;
+
+// Keypad input recording. On disk:
+//   "C8MV" u16 version, u8 profile, u8 timing, u16 instructions per frame,
+//   u32 rng seed, then per event a LEB128 frame delta and a u16 pad mask,
+//   all little-endian, until end of file.
+typedef struct
+{
+    FILE *fp; // recording only
+    uint64_t lastFrame;
+    uint16_t lastPad; // recording only, the pad as of the last event
+    MovieEvent *events; // playback only
+    uint32_t count;
+    uint32_t next;
+    int profile;
+    int timing;
+    int instructionsPerFrame;
+    uint32_t seed;
+} Movie;
+
+Movie *createMovie(FILE *fpout, const Chip *c, int instructionsPerFrame);
+void recordMovie(Movie *m, uint64_t frame, uint16_t pad);
+void recordPad(Movie *m, const Chip *c);
+Movie *loadMovie(FILE *fpin);
+void playMovie(Movie *m, Chip *c);
+int movieFinished(const Movie *m);
+void closeMovie(Movie *m);
+
+#endif
@@ -0,0 +1,49 @@
+#include "net.h"
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// listens on port on the loopback interface and returns the listening
+// socket, -1 on error. With nonblocking set, accept returns at once when
+// no client is waiting, for servers that poll between frames.
+int listenLoopback(int port, int nonblocking)
+{
+    int server = socket(AF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    struct sockaddr_in sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(port);
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (server < 0)
+    {
+        return -1;
+    }
+    setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (bind(server, (struct sockaddr *)&sa, sizeof(sa)) != 0 || listen(server, 1) != 0 ||
+        (nonblocking && fcntl(server, F_SETFL, fcntl(server, F_GETFL) | O_NONBLOCK) != 0))
+    {
+        close(server);
+        return -1;
+    }
+    fprintf(stderr, "listening on 127.0.0.1:%d\n", port);
+    return server;
+}
+
+// waits for one client to connect to port on the loopback interface and
+// returns its socket, -1 on error
+int acceptLoopback(int port)
+{
+    int server = listenLoopback(port, 0);
+    if (server < 0)
+    {
+        return -1;
+    }
+    int client = accept(server, NULL, NULL);
+    close(server);
+    return client;
+}
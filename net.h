@@ -0,0 +1,7 @@
+#ifndef NET_H
+#define NET_H
+
+int listenLoopback(int port, int nonblocking);
+int acceptLoopback(int port);
+
+#endif
@@ -0,0 +1,108 @@
+#include "shared.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Creates the POSIX shared-memory object name ("/chip8" style) and maps
+// it; readers open the same name. Returns NULL on error.
+SharedExport *createSharedExport(const char *name)
+{
+    SharedExport *s = calloc(1, sizeof(SharedExport));
+    if (s == NULL || snprintf(s->name, sizeof(s->name), "%s", name) >= (int)sizeof(s->name))
+    {
+        free(s);
+        return NULL;
+    }
+    s->fd = shm_open(name, O_CREAT | O_RDWR, 0600);
+    if (s->fd < 0)
+    {
+        free(s);
+        return NULL;
+    }
+    if (ftruncate(s->fd, sizeof(SharedState)) != 0 ||
+        (s->state = mmap(NULL, sizeof(SharedState), PROT_READ | PROT_WRITE, MAP_SHARED, s->fd, 0)) == MAP_FAILED)
+    {
+        close(s->fd);
+        shm_unlink(name);
+        free(s);
+        return NULL;
+    }
+    memset(s->state, 0, sizeof(SharedState));
+    s->state->magic = SHARED_MAGIC;
+    s->state->version = SHARED_VERSION;
+    return s;
+}
+
+// applies the keys readers pressed and released since the last frame,
+// recording each half in movie unless it is NULL
+void takeSharedKeys(SharedExport *s, Chip *c, Movie *movie)
+{
+    uint32_t pressed = atomic_exchange_explicit(&s->state->keysPressed, 0, memory_order_acquire);
+    uint32_t released = atomic_exchange_explicit(&s->state->keysReleased, 0, memory_order_acquire);
+    for (int key = 0; key < 16; key++)
+    {
+        if (pressed >> key & 1)
+        {
+            setKey(c, key, 1);
+        }
+    }
+    if (movie != NULL)
+    {
+        recordPad(movie, c);
+    }
+    for (int key = 0; key < 16; key++)
+    {
+        if (released >> key & 1)
+        {
+            setKey(c, key, 0);
+        }
+    }
+    if (movie != NULL)
+    {
+        recordPad(movie, c);
+    }
+}
+
+// publishes the frame just run: the sequence goes odd, the state is
+// written, then it goes even again
+void publishShared(SharedExport *s, const Chip *c)
+{
+    SharedState *out = s->state;
+    uint32_t sequence = atomic_load_explicit(&out->sequence, memory_order_relaxed);
+    atomic_store_explicit(&out->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    out->frame = c->frame;
+    out->hires = c->display->hires;
+    out->profile = c->profile;
+    out->exited = c->exited;
+    out->fault = c->fault;
+    out->pc = c->pc;
+    out->i = c->i;
+    out->sp = c->sp;
+    out->keypad = padMask(c);
+    memcpy(out->v, c->v, sizeof(out->v));
+    memcpy(out->stack, c->stack, sizeof(out->stack));
+    out->delayTimer = c->delayTimer;
+    out->soundTimer = c->soundTimer;
+    out->waitKey = c->waitKey;
+    out->pitch = c->pitch;
+    memcpy(out->planes, c->display->planes, sizeof(out->planes));
+
+    atomic_store_explicit(&out->sequence, sequence + 2, memory_order_release);
+}
+
+// unmaps and removes the segment; readers that still map it keep their view
+void destroySharedExport(SharedExport *s)
+{
+    if (s == NULL)
+    {
+        return;
+    }
+    munmap(s->state, sizeof(SharedState));
+    close(s->fd);
+    shm_unlink(s->name);
+    free(s);
+}
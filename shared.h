@@ -0,0 +1,81 @@
+#ifndef SHARED_H
+#define SHARED_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include "chip.h"
+#include "movie.h"
+
+#define SHARED_MAGIC 0x38504843 // "CHP8" little-endian
+#define SHARED_VERSION 1
+
+// The layout of the shared-memory segment, for the emulator and for the
+// processes reading it; include this header to map it. Published once per
+// frame under a seqlock: sequence is odd while the emulator is writing,
+// and a reader copies what it needs and retries if sequence changed (see
+// readShared). Planes use the packed Display layout, see display.h.
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    _Atomic uint32_t sequence;
+    uint32_t reserved;
+    // published by the emulator
+    uint64_t frame;
+    uint8_t hires;
+    uint8_t profile;
+    uint8_t exited;
+    uint8_t fault;
+    uint16_t pc;
+    uint16_t i;
+    uint16_t sp;
+    uint16_t keypad; // bit n is key n
+    uint8_t v[16];
+    uint16_t stack[16];
+    uint8_t delayTimer;
+    uint8_t soundTimer;
+    int8_t waitKey;
+    uint8_t pitch;
+    uint64_t planes[DISPLAY_PLANES][DISPLAY_HEIGHT][2];
+    // written by any reader with atomic_fetch_or, taken by the emulator at
+    // the start of each frame: presses first, then releases, so a key both
+    // pressed and released within one frame still completes FX0A
+    _Atomic uint32_t keysPressed;
+    _Atomic uint32_t keysReleased;
+} SharedState;
+
+// the emulator's side of a segment
+typedef struct
+{
+    char name[256];
+    int fd;
+    SharedState *state;
+} SharedExport;
+
+SharedExport *createSharedExport(const char *name);
+void takeSharedKeys(SharedExport *s, Chip *c, Movie *movie);
+void publishShared(SharedExport *s, const Chip *c);
+void destroySharedExport(SharedExport *s);
+
+// Copies a consistent snapshot of the segment into out, for readers.
+// Returns the frame it holds.
+static inline uint64_t readShared(SharedState *s, SharedState *out)
+{
+    for (;;)
+    {
+        uint32_t before = atomic_load_explicit(&s->sequence, memory_order_acquire);
+        if (before & 1)
+        {
+            continue;
+        }
+        memcpy((void *)out, (const void *)s, sizeof(SharedState));
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&s->sequence, memory_order_relaxed) == before)
+        {
+            return out->frame;
+        }
+    }
+}
+
+#endif
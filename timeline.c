@@ -0,0 +1,84 @@
+#include "timeline.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+Timeline *createTimeline(uint32_t capacity, uint64_t frameBudget)
+{
+    uint32_t size = 1;
+    while (size < capacity && size < 0x80000000u)
+    {
+        size <<= 1;
+    }
+
+    Timeline *tl = malloc(sizeof(Timeline));
+    if (tl == NULL)
+    {
+        return NULL;
+    }
+    tl->events = calloc(size, sizeof(TimelineEvent));
+    if (tl->events == NULL)
+    {
+        free(tl);
+        return NULL;
+    }
+    tl->mask = size - 1;
+    tl->count = 0;
+    tl->frame = 0;
+    tl->origin = timelineNow();
+    tl->budget = frameBudget;
+    return tl;
+}
+
+void destroyTimeline(Timeline *tl)
+{
+    if (tl == NULL)
+    {
+        return;
+    }
+    free(tl->events);
+    free(tl);
+}
+
+uint64_t timelineNow(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void timelineSpan(Timeline *tl, const char *name, uint64_t start, uint64_t end)
+{
+    TimelineEvent *e = &tl->events[tl->count & tl->mask];
+    e->name = name;
+    e->start = start;
+    e->duration = end - start;
+    e->frame = tl->frame;
+    tl->count++;
+}
+
+// writes the kept spans as complete ("X") trace events; frames over budget
+// get an "overrun" argument so they can be searched for in the viewer
+int writeTimeline(Timeline *tl, FILE *fpout)
+{
+    uint64_t capacity = (uint64_t)tl->mask + 1;
+    uint64_t first = tl->count > capacity ? tl->count - capacity : 0;
+
+    fprintf(fpout, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(fpout, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,"
+                   "\"args\":{\"name\":\"emulator\"}}");
+    for (uint64_t n = first; n < tl->count; n++)
+    {
+        TimelineEvent *e = &tl->events[n & tl->mask];
+        int overrun = strcmp(e->name, "frame") == 0 && e->duration > tl->budget;
+        fprintf(fpout, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,"
+                       "\"ts\":%llu,\"dur\":%llu,\"args\":{\"frame\":%llu%s}}",
+                e->name,
+                (unsigned long long)(e->start - tl->origin),
+                (unsigned long long)e->duration,
+                (unsigned long long)e->frame,
+                overrun ? ",\"overrun\":1" : "");
+    }
+    fprintf(fpout, "\n]}\n");
+    return ferror(fpout) ? -1 : 0;
+}
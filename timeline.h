@@ -0,0 +1,55 @@
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// a completed span of the run loop, times in microseconds
+typedef struct
+{
+    const char *name; // must outlive the timeline, normally a literal
+    uint64_t start;
+    uint64_t duration;
+    uint64_t frame;
+} TimelineEvent;
+
+// keeps the most recent spans, exported as Chrome trace-event JSON
+// (loads in chrome://tracing and ui.perfetto.dev)
+typedef struct
+{
+    TimelineEvent *events;
+    uint32_t mask;  // capacity - 1, capacity is a power of two
+    uint64_t count; // number of spans ever recorded
+    uint64_t frame; // current frame number, attached to each span
+    uint64_t origin;
+    uint64_t budget; // frame spans longer than this are flagged as overruns;
+                     // main starts a frame span after its sleep
+} Timeline;
+
+Timeline *createTimeline(uint32_t capacity, uint64_t frameBudget);
+void destroyTimeline(Timeline *tl);
+uint64_t timelineNow(void);
+void timelineSpan(Timeline *tl, const char *name, uint64_t start, uint64_t end);
+int writeTimeline(Timeline *tl, FILE *fpout);
+
+static inline uint64_t timelineBegin(Timeline *tl)
+{
+    return tl != NULL ? timelineNow() : 0;
+}
+
+static inline void timelineEnd(Timeline *tl, const char *name, uint64_t start)
+{
+    if (tl != NULL)
+    {
+        timelineSpan(tl, name, start, timelineNow());
+    }
+}
+
+// times the statement or block that follows it:
+//     TIMELINE_SPAN(tl, "draw") { draw(...); }
+// do not leave the block with break or return, the span would be lost
+#define TIMELINE_SPAN(tl, name)                                        \
+    for (uint64_t _spanStart = timelineBegin(tl), _spanDone = 0;      \
+         !_spanDone; _spanDone = 1, timelineEnd(tl, name, _spanStart))
+
+#endif
@@ -0,0 +1,96 @@
+#include "timing.h"
+
+// Execution cost of each instruction in the COSMAC VIP interpreter,
+// excluding the fetch. Values are from disassembly of the original
+// interpreter and are approximate for the instructions whose routines loop.
+// Indexed by the first nibble; families with sub-opcodes are refined below.
+static const unsigned short baseCycles[16] = {
+    10, // 0NNN: 00EE; 00E0 is refined below
+    12, // 1NNN
+    26, // 2NNN
+    10, // 3XNN, +4 when skipping
+    10, // 4XNN, +4 when skipping
+    14, // 5XY0, +4 when skipping
+    6,  // 6XNN
+    10, // 7XNN
+    44, // 8XYN, 8XY0 is refined below
+    14, // 9XY0, +4 when skipping
+    12, // ANNN
+    22, // BNNN
+    36, // CXNN
+    26, // DXYN setup, rows are added below
+    14, // EXNN, +4 when skipping
+    10, // FXNN, refined below
+};
+
+// cost of the instruction that just ran, given the pc before and after it
+// and the registers after it
+int vipCycles(unsigned short opcode, unsigned short pc, unsigned short nextPc, const unsigned char *v)
+{
+    int x = (opcode & 0x0F00) >> 8;
+    int cycles = VIP_FETCH_CYCLES + baseCycles[opcode >> 12];
+
+    switch (opcode >> 12)
+    {
+    case 0x0:
+        if (opcode == 0x00E0)
+        {
+            // clears the 256 byte display page one byte at a time
+            cycles += 3078;
+        }
+        break;
+    case 0x3:
+    case 0x4:
+    case 0x5:
+    case 0x9:
+    case 0xE:
+        if (nextPc == pc + 4)
+        {
+            cycles += 4;
+        }
+        break;
+    case 0x8:
+        if ((opcode & 0xF) == 0)
+        {
+            cycles = VIP_FETCH_CYCLES + 12;
+        }
+        break;
+    case 0xB:
+        // extra cycle pair when the target crosses a page
+        if (((opcode & 0x0FFF) & 0xF00) != (nextPc & 0xF00))
+        {
+            cycles += 2;
+        }
+        break;
+    case 0xD:
+    {
+        // each row is shifted into place; sprites that straddle a display
+        // byte take the slower path through the shift loop
+        int rows = opcode & 0xF;
+        int aligned = (v[x] & 7) == 0;
+        cycles += rows * (aligned ? 46 : 66);
+        break;
+    }
+    case 0xF:
+        switch (opcode & 0xFF)
+        {
+        case 0x1E:
+        case 0x29:
+            cycles += 6;
+            break;
+        case 0x33:
+        {
+            // the conversion subtracts powers of ten digit by digit
+            int n = v[x];
+            cycles += 74 + 16 * (n / 100 + (n / 10) % 10 + n % 10);
+            break;
+        }
+        case 0x55:
+        case 0x65:
+            cycles += 4 + 14 * (x + 1);
+            break;
+        }
+        break;
+    }
+    return cycles;
+}
@@ -0,0 +1,12 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+// COSMAC VIP timing, in 1802 machine cycles (8 clocks at 1.7609 MHz)
+
+#define VIP_CYCLES_PER_FRAME 3668 // one 60 Hz field
+#define VIP_INTERRUPT_CYCLES 1060 // 1861 display DMA plus the interrupt routine
+#define VIP_FETCH_CYCLES 40       // interpreter fetch and dispatch, every instruction
+
+int vipCycles(unsigned short opcode, unsigned short pc, unsigned short nextPc, const unsigned char *v);
+
+#endif
@@ -0,0 +1,114 @@
+#include "trace.h"
+#include <stdlib.h>
+#include <string.h>
+
+Trace *createTrace(uint32_t capacity)
+{
+    // round capacity up to a power of two so indexing is a mask
+    uint32_t size = 1;
+    while (size < capacity && size < 0x80000000u)
+    {
+        size <<= 1;
+    }
+
+    Trace *t = malloc(sizeof(Trace));
+    if (t == NULL)
+    {
+        return NULL;
+    }
+    t->entries = calloc(size, sizeof(TraceEntry));
+    if (t->entries == NULL)
+    {
+        free(t);
+        return NULL;
+    }
+    t->mask = size - 1;
+    atomic_init(&t->head, 0);
+    return t;
+}
+
+void destroyTrace(Trace *t)
+{
+    if (t == NULL)
+    {
+        return;
+    }
+    free(t->entries);
+    free(t);
+}
+
+static void putU16(unsigned char *p, uint16_t x)
+{
+    p[0] = x & 0xFF;
+    p[1] = x >> 8;
+}
+
+static void putU32(unsigned char *p, uint32_t x)
+{
+    putU16(p, x & 0xFFFF);
+    putU16(p + 2, x >> 16);
+}
+
+static void putU64(unsigned char *p, uint64_t x)
+{
+    putU32(p, x & 0xFFFFFFFF);
+    putU32(p + 4, x >> 32);
+}
+
+// writes the recorded entries, oldest first, in the packed little-endian format:
+//   "C8TR" u16 version, u16 entry size, u32 count, u32 reserved, u64 total recorded
+//   count * (u16 pc, u16 opcode, u16 i, u8 reg, u8 value)
+// returns 0 on success
+int writeTrace(Trace *t, FILE *fpout)
+{
+    uint32_t capacity = t->mask + 1;
+    TraceEntry *copy = malloc(capacity * sizeof(TraceEntry));
+    if (copy == NULL)
+    {
+        return -1;
+    }
+
+    // copy the ring, then drop whatever the writer overwrote while we copied.
+    // The writer fills entry after in its slot before publishing after + 1,
+    // so the entry after - capacity may be torn as well.
+    uint64_t head = atomic_load_explicit(&t->head, memory_order_acquire);
+    uint64_t first = head > capacity ? head - capacity : 0;
+    for (uint64_t n = first; n < head; n++)
+    {
+        copy[n & t->mask] = t->entries[n & t->mask];
+    }
+    atomic_thread_fence(memory_order_acquire);
+    uint64_t after = atomic_load_explicit(&t->head, memory_order_relaxed);
+    if (after + 1 > capacity && after + 1 - capacity > first)
+    {
+        first = after + 1 - capacity;
+    }
+    if (first > head)
+    {
+        first = head;
+    }
+    uint32_t count = head - first;
+
+    unsigned char header[24];
+    memcpy(header, TRACE_MAGIC, 4);
+    putU16(header + 4, TRACE_VERSION);
+    putU16(header + 6, 8);
+    putU32(header + 8, count);
+    putU32(header + 12, 0);
+    putU64(header + 16, head);
+    int err = fwrite(header, sizeof(header), 1, fpout) != 1;
+
+    for (uint64_t n = first; n < head && !err; n++)
+    {
+        TraceEntry *e = &copy[n & t->mask];
+        unsigned char rec[8];
+        putU16(rec, e->pc);
+        putU16(rec + 2, e->opcode);
+        putU16(rec + 4, e->i);
+        rec[6] = e->reg;
+        rec[7] = e->value;
+        err = fwrite(rec, sizeof(rec), 1, fpout) != 1;
+    }
+    free(copy);
+    return err ? -1 : 0;
+}
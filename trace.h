@@ -0,0 +1,78 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdatomic.h>
+
+#define TRACE_MAGIC "C8TR"
+#define TRACE_VERSION 1
+#define TRACE_NO_REG 0xFF
+
+// one executed instruction, stored packed in 8 bytes
+typedef struct
+{
+    uint16_t pc;
+    uint16_t opcode;
+    uint16_t i;
+    uint8_t reg;   // register written by the instruction, TRACE_NO_REG if none
+    uint8_t value; // value of that register after the instruction
+} TraceEntry;
+
+// flight recorder: a single writer (the emulation thread) overwrites the
+// oldest entries, readers take a consistent snapshot without locking
+typedef struct
+{
+    TraceEntry *entries;
+    uint32_t mask;          // capacity - 1, capacity is a power of two
+    _Atomic uint64_t head; // number of entries ever recorded
+} Trace;
+
+Trace *createTrace(uint32_t capacity);
+void destroyTrace(Trace *t);
+int writeTrace(Trace *t, FILE *fpout);
+
+// register an opcode writes to, as reported in the trace
+static inline uint8_t traceWrittenReg(uint16_t opcode)
+{
+    switch (opcode >> 12)
+    {
+    case 0x6:
+    case 0x7:
+    case 0x8:
+    case 0xC:
+        return (opcode >> 8) & 0xF;
+    case 0xD:
+        return 0xF;
+    case 0x5:
+        // XO-CHIP 5XY3 loads VX-VY, VX reported
+        return (opcode & 0xF) == 3 ? (opcode >> 8) & 0xF : TRACE_NO_REG;
+    case 0xF:
+        switch (opcode & 0xFF)
+        {
+        case 0x07:
+        case 0x0A:
+        case 0x65:
+        case 0x85: // V0-VX from the RPL flags, VX reported
+            return (opcode >> 8) & 0xF;
+        case 0x1E:
+            return 0xF;
+        }
+    }
+    return TRACE_NO_REG;
+}
+
+static inline void traceRecord(Trace *t, uint16_t pc, uint16_t opcode, uint16_t i, const unsigned char *v)
+{
+    uint64_t head = atomic_load_explicit(&t->head, memory_order_relaxed);
+    TraceEntry *e = &t->entries[head & t->mask];
+    e->pc = pc;
+    e->opcode = opcode;
+    e->i = i;
+    e->reg = traceWrittenReg(opcode);
+    e->value = e->reg == TRACE_NO_REG ? 0 : v[e->reg];
+    // publish the entry only once it is fully written
+    atomic_store_explicit(&t->head, head + 1, memory_order_release);
+}
+
+#endif
@@ -0,0 +1,138 @@
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+// Offline decoder for traces written with --trace.
+//
+//   tracedump [-p ADDR[-ADDR]] [-o PATTERN] [-n LAST] file
+//
+// -p keeps entries whose pc is in the range, -o keeps opcodes matching a
+// 4 character pattern where hex digits must match and anything else is a
+// wildcard (e.g. "8xy4", "Dxyn", "F_65"), -n prints only the last entries.
+
+static uint16_t getU16(const unsigned char *p)
+{
+    return p[0] | p[1] << 8;
+}
+
+static uint32_t getU32(const unsigned char *p)
+{
+    return getU16(p) | (uint32_t)getU16(p + 2) << 16;
+}
+
+static uint64_t getU64(const unsigned char *p)
+{
+    return getU32(p) | (uint64_t)getU32(p + 4) << 32;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: tracedump [-p ADDR[-ADDR]] [-o PATTERN] [-n LAST] file\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long pcLow = 0, pcHigh = 0xFFFF;
+    uint16_t opMask = 0, opValue = 0;
+    unsigned long last = 0;
+    const char *path = NULL;
+
+    for (int a = 1; a < argc; a++)
+    {
+        if (strcmp(argv[a], "-p") == 0 && a + 1 < argc)
+        {
+            char *end;
+            pcLow = strtoul(argv[++a], &end, 16);
+            pcHigh = *end == '-' ? strtoul(end + 1, NULL, 16) : pcLow;
+        }
+        else if (strcmp(argv[a], "-o") == 0 && a + 1 < argc)
+        {
+            const char *pat = argv[++a];
+            if (strlen(pat) != 4)
+            {
+                usage();
+            }
+            for (int k = 0; k < 4; k++)
+            {
+                int shift = 12 - 4 * k;
+                if (isxdigit((unsigned char)pat[k]))
+                {
+                    char digit[2] = {pat[k], 0};
+                    opMask |= 0xF << shift;
+                    opValue |= strtoul(digit, NULL, 16) << shift;
+                }
+            }
+        }
+        else if (strcmp(argv[a], "-n") == 0 && a + 1 < argc)
+        {
+            last = strtoul(argv[++a], NULL, 10);
+        }
+        else if (argv[a][0] == '-' || path != NULL)
+        {
+            usage();
+        }
+        else
+        {
+            path = argv[a];
+        }
+    }
+    if (path == NULL)
+    {
+        usage();
+    }
+
+    FILE *fpin = fopen(path, "rb");
+    if (fpin == NULL)
+    {
+        fprintf(stderr, "Error opening trace %s\n", path);
+        return 1;
+    }
+
+    unsigned char header[24];
+    if (fread(header, sizeof(header), 1, fpin) != 1 || memcmp(header, TRACE_MAGIC, 4) != 0)
+    {
+        fprintf(stderr, "%s is not a trace file\n", path);
+        return 1;
+    }
+    if (getU16(header + 4) != TRACE_VERSION || getU16(header + 6) != 8)
+    {
+        fprintf(stderr, "unsupported trace version %u\n", getU16(header + 4));
+        return 1;
+    }
+    uint32_t count = getU32(header + 8);
+    uint64_t total = getU64(header + 16);
+    // sequence number of the first entry in the file
+    uint64_t seq = total - count;
+
+    printf("# %u of %llu instructions recorded\n", count, (unsigned long long)total);
+    unsigned char rec[8];
+    for (uint32_t n = 0; n < count; n++, seq++)
+    {
+        if (fread(rec, sizeof(rec), 1, fpin) != 1)
+        {
+            fprintf(stderr, "trace truncated after %u entries\n", n);
+            return 1;
+        }
+        if (last != 0 && count - n > last)
+        {
+            continue;
+        }
+        uint16_t pc = getU16(rec);
+        uint16_t opcode = getU16(rec + 2);
+        if (pc < pcLow || pc > pcHigh || (opcode & opMask) != opValue)
+        {
+            continue;
+        }
+        printf("%10llu  %04X  %04X  I=%04X", (unsigned long long)seq, pc, opcode, getU16(rec + 4));
+        if (rec[6] != TRACE_NO_REG)
+        {
+            printf("  V%X=%02X", rec[6], rec[7]);
+        }
+        putchar('\n');
+    }
+    fclose(fpin);
+    return 0;
+}